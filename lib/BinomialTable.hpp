@@ -0,0 +1,137 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * Table of the binomial coefficients C(n,k) for 0 <= k <= n <= maxN. It replaces
+ * the old Factorial/Binomial classes in the basis computation.
+ * The coefficients are built by Pascal's rule in 64-bit integers, so they are
+ * exact as long as they fit. Larger coefficients are kept in the log domain
+ * (long double), T values which do not fit into T are detected, see Get().
+ */
+template<class T>
+class BinomialTable
+{
+public:
+    // ---- public member functions ----
+    explicit BinomialTable(int _maxN) :
+        maxN_(_maxN)
+    {
+        if (maxN_ < 0)
+        {
+            throw std::invalid_argument("BinomialTable<T>::BinomialTable(): maxN must be non-negative.");
+        }
+
+        std::size_t size = Index(maxN_ + 1, 0);
+
+        exact_.resize(size);
+        logs_.resize(size);
+        values_.resize(size);
+
+        const long double maxLog = std::log(static_cast<long double>(std::numeric_limits<T>::max()));
+
+        for (int n = 0; n <= maxN_; ++n)
+        {
+            for (int k = 0; k <= n; ++k)
+            {
+                std::size_t index = Index(n, k);
+
+                if (k == 0 || k == n)
+                {
+                    exact_[index] = 1;
+                }
+                else
+                {
+                    // 0 marks a coefficient which does not fit into 64 bits
+                    std::uint64_t a = exact_[Index(n - 1, k - 1)];
+                    std::uint64_t b = exact_[Index(n - 1, k)];
+
+                    exact_[index] = (a == 0 || b == 0 || a > std::numeric_limits<std::uint64_t>::max() - b) ? 0 : a + b;
+                }
+
+                if (exact_[index] != 0)
+                {
+                    logs_[index] = std::log(static_cast<long double>(exact_[index]));
+                    values_[index] = static_cast<T>(exact_[index]);
+                }
+                else
+                {
+                    logs_[index] = std::lgamma(static_cast<long double>(n + 1)) -
+                        std::lgamma(static_cast<long double>(k + 1)) -
+                        std::lgamma(static_cast<long double>(n - k + 1));
+                    values_[index] = logs_[index] < maxLog ? static_cast<T>(std::exp(logs_[index])) : std::numeric_limits<T>::infinity();
+                }
+            }
+        }
+    }
+
+    int GetMaxN() const
+    {
+        return maxN_;
+    }
+
+    /**
+ * C(n,k) converted to T, 0 for k < 0 or k > n. Throws std::out_of_range if n is
+ * not in the table and std::overflow_error if C(n,k) does not fit into T.
+ */
+    T Get(int _n, int _k) const
+    {
+        if (_n < 0 || _n > maxN_)
+        {
+            throw std::out_of_range("BinomialTable<T>::Get(): n = " + std::to_string(_n) + " is not in [0, " + std::to_string(maxN_) + "]");
+        }
+
+        if (_k < 0 || _k > _n)
+        {
+            return static_cast<T>(0);
+        }
+
+        T value = values_[Index(_n, _k)];
+
+        if (std::isinf(value))
+        {
+            throw std::overflow_error("BinomialTable<T>::Get(): C(" + std::to_string(_n) + ", " + std::to_string(_k) + ") does not fit into the moment type.");
+        }
+
+        return value;
+    }
+
+    /// Natural logarithm of C(n,k), 0 <= k <= n <= maxN
+    long double GetLog(int _n, int _k) const
+    {
+        return logs_[Index(_n, _k)];
+    }
+
+    /// True if C(n,k), 0 <= k <= n <= maxN, is stored as an exact integer
+    bool IsExact(int _n, int _k) const
+    {
+        return exact_[Index(_n, _k)] != 0;
+    }
+
+    /// 2^e, exact for every representable power
+    static T PowerOfTwo(int _e)
+    {
+        return std::ldexp(static_cast<T>(1), _e);
+    }
+
+private:
+    // ---- private member functions ----
+    static std::size_t Index(int _n, int _k)
+    {
+        return static_cast<std::size_t>(_n) * (_n + 1) / 2 + _k;
+    }
+
+    // ---- private attributes -----
+    std::vector<std::uint64_t>  exact_;     // exact coefficients, 0 if they do not fit
+    std::vector<long double>    logs_;      // logarithms of all coefficients
+    std::vector<T>              values_;    // coefficients converted to T, infinity if they do not fit
+    int                         maxN_;      // the largest n in the table
+};
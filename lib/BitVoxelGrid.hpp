@@ -0,0 +1,422 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+#include <intrin.h>
+#endif
+
+namespace bit_voxel_detail
+{
+    inline int PopCount(std::uint64_t _word)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_popcountll(_word);
+#else
+        _word = _word - ((_word >> 1) & 0x5555555555555555ULL);
+        _word = (_word & 0x3333333333333333ULL) + ((_word >> 2) & 0x3333333333333333ULL);
+        _word = (_word + (_word >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        return static_cast<int>((_word * 0x0101010101010101ULL) >> 56);
+#endif
+    }
+
+    /// Index of the lowest set bit, _word must not be 0
+    inline int CountTrailingZeros(std::uint64_t _word)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctzll(_word);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+        unsigned long index;
+        _BitScanForward64(&index, _word);
+        return static_cast<int>(index);
+#else
+        int index = 0;
+        while ((_word & 1) == 0)
+        {
+            _word >>= 1;
+            ++index;
+        }
+        return index;
+#endif
+    }
+}
+
+/**
+ * Binary cubic voxel grid packed into 64-bit words along x. Every line (y, z)
+ * starts at a new word, the bits after the end of a line are always 0.
+ * Iterator gives the usual dense view in canonical order (x fastest), so the
+ * grid works with every template of the library. ZernikeDescriptor and
+ * ScaledGeometricalMoments have overloads which work on whole words instead:
+ * popcount for the voxel counts, bit scans for the runs along x and masks for
+ * the cutoff at the unit ball.
+ */
+class BitVoxelGrid
+{
+public:
+    typedef std::uint64_t Word;
+
+    static constexpr int wordBits = 64;
+
+    /// Proxy for a single voxel
+    class Reference
+    {
+    public:
+        Reference(Word * _word, Word _mask) :
+            word_(_word), mask_(_mask)
+        {
+        }
+
+        operator bool() const
+        {
+            return (*word_ & mask_) != 0;
+        }
+
+        Reference & operator=(bool _value)
+        {
+            if (_value)
+            {
+                *word_ |= mask_;
+            }
+            else
+            {
+                *word_ &= ~mask_;
+            }
+
+            return *this;
+        }
+
+        Reference & operator=(const Reference & _other)
+        {
+            return *this = static_cast<bool>(_other);
+        }
+
+    private:
+        Word *  word_;
+        Word    mask_;
+    };
+
+    /// Random access iterator over the voxels in canonical order, index (z * dim + y) * dim + x
+    class Iterator
+    {
+    public:
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef bool                            value_type;
+        typedef std::ptrdiff_t                  difference_type;
+        typedef Reference                       reference;
+        typedef void                            pointer;
+
+        Iterator() :
+            grid_(nullptr), index_(0)
+        {
+        }
+
+        Iterator(BitVoxelGrid * _grid, difference_type _index) :
+            grid_(_grid), index_(_index)
+        {
+        }
+
+        Reference operator*() const
+        {
+            return (*this)[0];
+        }
+
+        Reference operator[](difference_type _offset) const
+        {
+            std::size_t index = static_cast<std::size_t>(index_ + _offset);
+            std::size_t dim = static_cast<std::size_t>(grid_->dim_);
+
+            return grid_->GetReference(index % dim, index / dim);
+        }
+
+        Iterator & operator++()
+        {
+            ++index_;
+            return *this;
+        }
+
+        Iterator operator++(int)
+        {
+            Iterator old(*this);
+            ++index_;
+            return old;
+        }
+
+        Iterator & operator--()
+        {
+            --index_;
+            return *this;
+        }
+
+        Iterator operator--(int)
+        {
+            Iterator old(*this);
+            --index_;
+            return old;
+        }
+
+        Iterator & operator+=(difference_type _offset)
+        {
+            index_ += _offset;
+            return *this;
+        }
+
+        Iterator & operator-=(difference_type _offset)
+        {
+            index_ -= _offset;
+            return *this;
+        }
+
+        Iterator operator+(difference_type _offset) const
+        {
+            return Iterator(grid_, index_ + _offset);
+        }
+
+        Iterator operator-(difference_type _offset) const
+        {
+            return Iterator(grid_, index_ - _offset);
+        }
+
+        difference_type operator-(const Iterator & _other) const
+        {
+            return index_ - _other.index_;
+        }
+
+        bool operator==(const Iterator & _other) const
+        {
+            return index_ == _other.index_;
+        }
+
+        bool operator!=(const Iterator & _other) const
+        {
+            return index_ != _other.index_;
+        }
+
+        bool operator<(const Iterator & _other) const
+        {
+            return index_ < _other.index_;
+        }
+
+        bool operator>(const Iterator & _other) const
+        {
+            return index_ > _other.index_;
+        }
+
+        bool operator<=(const Iterator & _other) const
+        {
+            return index_ <= _other.index_;
+        }
+
+        bool operator>=(const Iterator & _other) const
+        {
+            return index_ >= _other.index_;
+        }
+
+    private:
+        BitVoxelGrid *      grid_;
+        difference_type     index_;
+    };
+
+    // ---- public member functions ----
+    explicit BitVoxelGrid(int _dim = 0)
+    {
+        Reset(_dim);
+    }
+
+    /// Clears the grid and sets its dimension
+    void Reset(int _dim)
+    {
+        if (_dim < 0)
+        {
+            throw std::invalid_argument("BitVoxelGrid::Reset(): the dimension must be non-negative.");
+        }
+
+        dim_ = _dim;
+        wordsPerLine_ = (_dim + wordBits - 1) / wordBits;
+        words_.assign(static_cast<std::size_t>(wordsPerLine_) * _dim * _dim, 0);
+    }
+
+    int GetDim() const
+    {
+        return dim_;
+    }
+
+    int GetWordsPerLine() const
+    {
+        return wordsPerLine_;
+    }
+
+    /// Number of the lines along x, the line (y, z) has the index z * dim + y
+    std::size_t GetLineCount() const
+    {
+        return static_cast<std::size_t>(dim_) * dim_;
+    }
+
+    const Word * GetLine(std::size_t _line) const
+    {
+        return words_.data() + _line * wordsPerLine_;
+    }
+
+    Word * GetLine(std::size_t _line)
+    {
+        return words_.data() + _line * wordsPerLine_;
+    }
+
+    bool Get(int _x, int _y, int _z) const
+    {
+        const Word * line = GetLine(static_cast<std::size_t>(_z) * dim_ + _y);
+        return (line[_x / wordBits] >> (_x % wordBits) & 1) != 0;
+    }
+
+    void Set(int _x, int _y, int _z, bool _value)
+    {
+        GetReference(_x, static_cast<std::size_t>(_z) * dim_ + _y) = _value;
+    }
+
+    /// Sets the voxels [_xBegin, _xEnd) of the line _line
+    void SetRun(std::size_t _line, int _xBegin, int _xEnd)
+    {
+        Word * line = GetLine(_line);
+
+        for (int x = _xBegin; x < _xEnd; )
+        {
+            int bit = x % wordBits;
+            int count = std::min(_xEnd - x, wordBits - bit);
+
+            line[x / wordBits] |= LowMask(count) << bit;
+            x += count;
+        }
+    }
+
+    /// Number of the set voxels of a line
+    std::size_t CountVoxels(std::size_t _line) const
+    {
+        const Word * line = GetLine(_line);
+        std::size_t count = 0;
+
+        for (int w = 0; w < wordsPerLine_; ++w)
+        {
+            count += bit_voxel_detail::PopCount(line[w]);
+        }
+
+        return count;
+    }
+
+    /// Number of the set voxels
+    std::size_t CountVoxels() const
+    {
+        std::size_t count = 0;
+
+        for (Word word : words_)
+        {
+            count += bit_voxel_detail::PopCount(word);
+        }
+
+        return count;
+    }
+
+    /**
+ * Calls _visitor(xBegin, xEnd) for every maximal run of set voxels
+ * [xBegin, xEnd) of a line. The runs are found with bit scans, so the cost
+ * depends on the number of words and runs, not on the number of voxels.
+ */
+    template<class Visitor>
+    void ForEachRun(std::size_t _line, Visitor && _visitor) const
+    {
+        const Word * line = GetLine(_line);
+        int runBegin = -1;      // begin of a run which reaches the end of the previous word
+
+        for (int w = 0; w < wordsPerLine_; ++w)
+        {
+            Word word = line[w];
+            int base = w * wordBits;
+
+            if (runBegin >= 0 && (word & 1) == 0)
+            {
+                _visitor(runBegin, base);
+                runBegin = -1;
+            }
+
+            while (word != 0)
+            {
+                int begin = bit_voxel_detail::CountTrailingZeros(word);
+                Word rest = ~(word | LowMask(begin));
+
+                if (rest == 0)
+                {
+                    // the run continues in the next word
+                    if (runBegin < 0)
+                    {
+                        runBegin = base + begin;
+                    }
+                    break;
+                }
+
+                int end = bit_voxel_detail::CountTrailingZeros(rest);
+
+                _visitor(runBegin >= 0 ? runBegin : base + begin, base + end);
+                runBegin = -1;
+
+                word &= ~LowMask(end);
+            }
+        }
+
+        if (runBegin >= 0)
+        {
+            _visitor(runBegin, dim_);
+        }
+    }
+
+    /// Clears the voxels of a line outside of [_xBegin, _xEnd)
+    void ClipLine(std::size_t _line, int _xBegin, int _xEnd)
+    {
+        Word * line = GetLine(_line);
+
+        _xBegin = std::max(_xBegin, 0);
+        _xEnd = std::min(_xEnd, dim_);
+
+        for (int w = 0; w < wordsPerLine_; ++w)
+        {
+            int base = w * wordBits;
+            int begin = std::min(std::max(_xBegin - base, 0), static_cast<int>(wordBits));
+            int end = std::min(std::max(_xEnd - base, 0), static_cast<int>(wordBits));
+
+            line[w] &= begin < end ? LowMask(end) & ~LowMask(begin) : 0;
+        }
+    }
+
+    Iterator begin()
+    {
+        return Iterator(this, 0);
+    }
+
+    Iterator end()
+    {
+        return Iterator(this, static_cast<Iterator::difference_type>(GetLineCount()) * dim_);
+    }
+
+private:
+    // ---- private member functions ----
+    /// Bits [0, _count), 0 <= _count <= 64
+    static Word LowMask(int _count)
+    {
+        return _count >= wordBits ? ~Word(0) : (Word(1) << _count) - 1;
+    }
+
+    Reference GetReference(std::size_t _x, std::size_t _line)
+    {
+        return Reference(GetLine(_line) + _x / wordBits, Word(1) << (_x % wordBits));
+    }
+
+    // ---- private attributes -----
+    std::vector<Word>   words_;
+    int                 dim_;           // length of the edge of the grid
+    int                 wordsPerLine_;  // words of a line along x
+};
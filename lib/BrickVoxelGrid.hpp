@@ -0,0 +1,315 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "BitVoxelGrid.hpp"
+
+/**
+ * Sparse binary cubic voxel grid of bricks of 8^3 voxels. A brick is empty,
+ * full or mixed, only a mixed brick keeps its voxels: 8 words, one per plane x,
+ * with one byte per line (x, z) and one bit per y. So a grid of 1024^3 voxels
+ * needs 4 bytes per brick and 64 bytes per mixed brick, the empty space and the
+ * interior of a solid cost next to nothing. ZernikeDescriptor and
+ * ScaledGeometricalMoments have overloads which take the moments of a full
+ * brick in closed form and the ones of a mixed brick from its runs along y.
+ */
+class BrickVoxelGrid
+{
+public:
+    typedef std::uint64_t Word;
+
+    static constexpr int brickDim = 8;      // edge of a brick
+    static constexpr int brickWords = 8;    // words of a mixed brick
+
+    // ---- public member functions ----
+    explicit BrickVoxelGrid(int _dim = 0)
+    {
+        Reset(_dim);
+    }
+
+    /// Clears the grid and sets its dimension
+    void Reset(int _dim)
+    {
+        if (_dim < 0)
+        {
+            throw std::invalid_argument("BrickVoxelGrid::Reset(): the dimension must be non-negative.");
+        }
+
+        dim_ = _dim;
+        bricksPerEdge_ = (_dim + brickDim - 1) / brickDim;
+        slots_.assign(static_cast<std::size_t>(bricksPerEdge_) * bricksPerEdge_ * bricksPerEdge_, emptySlot);
+        masks_.clear();
+        freeSlots_.clear();
+    }
+
+    int GetDim() const
+    {
+        return dim_;
+    }
+
+    /// Number of the bricks along an edge of the grid
+    int GetBricksPerEdge() const
+    {
+        return bricksPerEdge_;
+    }
+
+    /// Number of the bricks, the brick (bx, by, bz) has the index (bz * n + by) * n + bx
+    std::size_t GetBrickCount() const
+    {
+        return slots_.size();
+    }
+
+    std::size_t GetBrickIndex(int _bx, int _by, int _bz) const
+    {
+        return (static_cast<std::size_t>(_bz) * bricksPerEdge_ + _by) * bricksPerEdge_ + _bx;
+    }
+
+    /// First voxel of a brick
+    void GetBrickOrigin(std::size_t _brick, int & _x, int & _y, int & _z) const
+    {
+        _x = static_cast<int>(_brick % bricksPerEdge_) * brickDim;
+        _y = static_cast<int>(_brick / bricksPerEdge_ % bricksPerEdge_) * brickDim;
+        _z = static_cast<int>(_brick / bricksPerEdge_ / bricksPerEdge_) * brickDim;
+    }
+
+    bool IsEmpty(std::size_t _brick) const
+    {
+        return slots_[_brick] == emptySlot;
+    }
+
+    bool IsFull(std::size_t _brick) const
+    {
+        return slots_[_brick] == fullSlot;
+    }
+
+    /// Voxels of a mixed brick, nullptr for an empty or a full brick
+    const Word * GetMask(std::size_t _brick) const
+    {
+        std::uint32_t slot = slots_[_brick];
+
+        return slot >= fullSlot ? nullptr : masks_.data() + static_cast<std::size_t>(slot) * brickWords;
+    }
+
+    /// Voxels of a brick which becomes mixed, the voxels of a full brick are set
+    Word * MakeMixed(std::size_t _brick)
+    {
+        std::uint32_t & slot = slots_[_brick];
+
+        if (slot < fullSlot)
+        {
+            return masks_.data() + static_cast<std::size_t>(slot) * brickWords;
+        }
+
+        Word fill = slot == fullSlot ? ~Word(0) : Word(0);
+
+        if (!freeSlots_.empty())
+        {
+            slot = freeSlots_.back();
+            freeSlots_.pop_back();
+        }
+        else
+        {
+            slot = static_cast<std::uint32_t>(masks_.size() / brickWords);
+            masks_.resize(masks_.size() + brickWords);
+        }
+
+        Word * mask = masks_.data() + static_cast<std::size_t>(slot) * brickWords;
+        std::fill(mask, mask + brickWords, fill);
+
+        return mask;
+    }
+
+    /// Clears all voxels of a brick
+    void Clear(std::size_t _brick)
+    {
+        Release(_brick, emptySlot);
+    }
+
+    bool Get(int _x, int _y, int _z) const
+    {
+        std::size_t brick = GetBrickIndex(_x / brickDim, _y / brickDim, _z / brickDim);
+
+        if (IsFull(brick))
+        {
+            return true;
+        }
+
+        const Word * mask = GetMask(brick);
+
+        return mask != nullptr && (mask[_x % brickDim] >> LineShift(_z % brickDim) >> (_y % brickDim) & 1) != 0;
+    }
+
+    /// Sets the voxels (_x, y, _z), y in [_yBegin, _yEnd)
+    void SetRun(int _x, int _z, int _yBegin, int _yEnd)
+    {
+        if (_x < 0 || _x >= dim_ || _z < 0 || _z >= dim_ || _yBegin < 0 || _yBegin > _yEnd || _yEnd > dim_)
+        {
+            throw std::out_of_range("BrickVoxelGrid::SetRun(): the run is out of the grid.");
+        }
+
+        for (int y = _yBegin; y < _yEnd; )
+        {
+            int by = y / brickDim;
+            int end = std::min(_yEnd, (by + 1) * brickDim);
+            std::size_t brick = GetBrickIndex(_x / brickDim, by, _z / brickDim);
+
+            if (!IsFull(brick))
+            {
+                Word line = LineMask(y - by * brickDim, end - by * brickDim);
+
+                MakeMixed(brick)[_x % brickDim] |= line << LineShift(_z % brickDim);
+            }
+
+            y = end;
+        }
+    }
+
+    /// Clears the voxels of the line (_x, _z) of a brick outside of [_yBegin, _yEnd), local coordinates of the brick. A full brick becomes mixed.
+    void ClipLine(std::size_t _brick, int _x, int _z, int _yBegin, int _yEnd)
+    {
+        Word * mask = MakeMixed(_brick);
+
+        _yBegin = std::max(_yBegin, 0);
+        _yEnd = std::min(_yEnd, static_cast<int>(brickDim));
+
+        Word keep = _yBegin < _yEnd ? LineMask(_yBegin, _yEnd) : 0;
+
+        mask[_x] &= ~(LineMask(0, brickDim) << LineShift(_z)) | keep << LineShift(_z);
+    }
+
+    /**
+ * Turns the mixed bricks of the slab _bx whose voxels are all set into full
+ * bricks and the ones without voxels into empty bricks. Their words are reused
+ * by the next mixed bricks. The reader compacts every slab when it is
+ * complete, so the grid never keeps the words of the whole solid.
+ */
+    void Compact(int _bx)
+    {
+        for (int bz = 0; bz < bricksPerEdge_; ++bz)
+        {
+            for (int by = 0; by < bricksPerEdge_; ++by)
+            {
+                std::size_t brick = GetBrickIndex(_bx, by, bz);
+                const Word * mask = GetMask(brick);
+
+                if (mask == nullptr)
+                {
+                    continue;
+                }
+
+                bool full = true, empty = true;
+
+                for (int w = 0; w < brickWords; ++w)
+                {
+                    full = full && mask[w] == ~Word(0);
+                    empty = empty && mask[w] == 0;
+                }
+
+                if (full || empty)
+                {
+                    Release(brick, full ? fullSlot : emptySlot);
+                }
+            }
+        }
+    }
+
+    /// Compacts all slabs, see Compact(int)
+    void Compact()
+    {
+        for (int bx = 0; bx < bricksPerEdge_; ++bx)
+        {
+            Compact(bx);
+        }
+    }
+
+    /// Number of the set voxels
+    std::size_t CountVoxels() const
+    {
+        std::size_t count = 0;
+
+        for (std::size_t brick = 0; brick < slots_.size(); ++brick)
+        {
+            const Word * mask = GetMask(brick);
+
+            if (IsFull(brick))
+            {
+                count += brickDim * brickDim * brickDim;
+            }
+            else if (mask != nullptr)
+            {
+                for (int w = 0; w < brickWords; ++w)
+                {
+                    count += bit_voxel_detail::PopCount(mask[w]);
+                }
+            }
+        }
+
+        return count;
+    }
+
+    /**
+ * Calls _visitor(yBegin, yEnd) for every maximal run of set voxels of the line
+ * (_x, _z) of a mixed brick, local coordinates of the brick.
+ */
+    template<class Visitor>
+    static void ForEachRun(const Word * _mask, int _x, int _z, Visitor && _visitor)
+    {
+        Word line = _mask[_x] >> LineShift(_z) & LineMask(0, brickDim);
+
+        while (line != 0)
+        {
+            int begin = bit_voxel_detail::CountTrailingZeros(line);
+            int end = bit_voxel_detail::CountTrailingZeros(~(line | LineMask(0, begin)));
+
+            _visitor(begin, end);
+
+            line &= ~LineMask(0, end);
+        }
+    }
+
+private:
+    // states of a brick without words, see slots_
+    enum : std::uint32_t
+    {
+        emptySlot = 0xFFFFFFFF,
+        fullSlot = 0xFFFFFFFE
+    };
+
+    // ---- private member functions ----
+    /// Bits [_begin, _end) of a line, 0 <= _begin <= _end <= brickDim
+    static Word LineMask(int _begin, int _end)
+    {
+        return ((Word(1) << _end) - 1) & ~((Word(1) << _begin) - 1);
+    }
+
+    /// Position of the line _z in the word of its plane
+    static int LineShift(int _z)
+    {
+        return _z * brickDim;
+    }
+
+    /// Frees the words of a brick and gives it the state _slot
+    void Release(std::size_t _brick, std::uint32_t _slot)
+    {
+        if (slots_[_brick] < fullSlot)
+        {
+            freeSlots_.push_back(slots_[_brick]);
+        }
+
+        slots_[_brick] = _slot;
+    }
+
+    // ---- private attributes -----
+    std::vector<std::uint32_t>  slots_;         // per brick: emptySlot, fullSlot or the index of its words in masks_
+    std::vector<Word>           masks_;         // words of the mixed bricks
+    std::vector<std::uint32_t>  freeSlots_;     // unused words of masks_
+    int                         dim_;           // length of the edge of the grid
+    int                         bricksPerEdge_; // bricks along an edge of the grid
+};
@@ -0,0 +1,243 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+/*
+
+                          3D Zernike Moments
+    Copyright (C) 2003 by Computer Graphics Group, University of Bonn
+           http://www.cg.cs.uni-bonn.de/project-pages/3dsearch/
+
+Code by Marcin Novotni:     marcin@cs.uni-bonn.de
+
+for more information, see the paper:
+
+@inproceedings{novotni-2003-3d,
+    author = {M. Novotni and R. Klein},
+    title = {3{D} {Z}ernike Descriptors for Content Based Shape Retrieval},
+    booktitle = {The 8th ACM Symposium on Solid Modeling and Applications},
+    pages = {216--225},
+    year = {2003},
+    month = {June},
+    institution = {Universit\"{a}t Bonn},
+    conference = {The 8th ACM Symposium on Solid Modeling and Applications, June 16-20, Seattle, WA}
+}
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *                                License                                    *
+ *                                                                           *
+ *  This library is free software; you can redistribute it and/or modify it  *
+ *  under the terms of the GNU Library General Public License as published   *
+ *  by the Free Software Foundation, version 2.                              *
+ *                                                                           *
+ *  This library is distributed in the hope that it will be useful, but      *
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU        *
+ *  Library General Public License for more details.                         *
+ *                                                                           *
+ *  You should have received a copy of the GNU Library General Public        *
+ *  License along with this library; if not, write to the Free Software      *
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.                *
+ *                                                                           *
+\*===========================================================================*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <complex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/math/constants/constants.hpp>
+
+// ----- local program includes -----
+#include "ScaledGeometricMoments.hpp"
+
+/**
+ * One term of a compile-time coefficient table: the real or imaginary part
+ * value_ of the coefficient of the geometrical moment with the index col_
+ * (see GeometricalMomentIndex()).
+ */
+struct FixedZernikeTerm
+{
+    int     col_;
+    double  value_;
+};
+
+/**
+ * Coefficient tables of the Zernike moments of a fixed order N. There is no
+ * generic definition: a specialization per order is emitted into the build
+ * directory by the generate_fixed_basis tool (see ZERNIKE_FIXED_ORDERS in CMake).
+ * A specialization provides:
+ *   static constexpr int order, rowCount, realTermCount, imagTermCount;
+ *   static const int * RealRowOffsets();            // rowCount + 1 offsets into RealTerms()
+ *   static const FixedZernikeTerm * RealTerms();    // purely real coefficients
+ *   static const int * ImagRowOffsets();            // rowCount + 1 offsets into ImagTerms()
+ *   static const FixedZernikeTerm * ImagTerms();    // purely imaginary coefficients
+ * Rows are ordered by n, l (n - l even) and m = 0..l, see RowIndex().
+ */
+template<int N>
+struct FixedZernikeBasis;
+
+/**
+ * Class representing the Zernike moments of the fixed order N. It has the same
+ * interface as ZernikeMoments but its coefficients are compile-time constants,
+ * so there is no startup cost and no allocation at all.
+ */
+template<int N, class InputVoxelIterator, class MomentT>
+class FixedZernikeMoments
+{
+public:
+    // ---- public typedefs ----
+    typedef MomentT                 T;
+    typedef std::complex<T>         ComplexT;       // complex type
+    typedef FixedZernikeBasis<N>    BasisT;
+
+    typedef ScaledGeometricalMoments<InputVoxelIterator, MomentT>   ScaledGeometricalMomentsT;
+
+    /**
+ * Index of the moment [n,l,m] with m >= 0 in the flat table.
+ */
+    static constexpr int RowIndex(int _n, int _l, int _m)
+    {
+        int row = 0;
+
+        for (int n = 0; n < _n; ++n)
+        {
+            for (int l = n % 2; l <= n; l += 2)
+            {
+                row += l + 1;
+            }
+        }
+
+        for (int l = _n % 2; l < _l; l += 2)
+        {
+            row += l + 1;
+        }
+
+        return row + _m;
+    }
+
+public:
+    // ---- public member functions ----
+    FixedZernikeMoments() = default;
+
+    /**
+ * Nothing to compute, only checks that the requested order matches N.
+ */
+    void Init(int _order)
+    {
+        if (_order != N)
+        {
+            throw std::invalid_argument("FixedZernikeMoments<N>::Init(): order " + std::to_string(_order) + " does not match N = " + std::to_string(N));
+        }
+    }
+
+    /**
+ * Computes the Zernike moments. This computation is data dependent
+ * and has to be performed for each new object and/or transformation.
+ */
+    void Compute(const ScaledGeometricalMomentsT & _gm)
+    {
+        static_assert(BasisT::order == N, "FixedZernikeBasis<N> has a wrong order");
+        static_assert(BasisT::rowCount == RowIndex(N + 1, 0, 0), "FixedZernikeBasis<N> has a wrong number of rows");
+
+        constexpr T three_quarters_div_pi = boost::math::constants::three_quarters<T>() * 1 / boost::math::constants::pi<T>();
+
+        if (_gm.GetMaxOrder() < N)
+        {
+            throw std::invalid_argument("FixedZernikeMoments<N>::Compute(): the order of the geometrical moments is lower than N.");
+        }
+
+        const int * reRows = BasisT::RealRowOffsets();
+        const FixedZernikeTerm * reTerms = BasisT::RealTerms();
+        const int * imRows = BasisT::ImagRowOffsets();
+        const FixedZernikeTerm * imTerms = BasisT::ImagTerms();
+        const T * moments = _gm.GetMoments().data();
+
+        for (int row = 0; row < BasisT::rowCount; ++row)
+        {
+            MomentSum<T> re, im;
+
+            // conj(c) * moment, the moments are real
+            for (int i = reRows[row]; i < reRows[row + 1]; ++i)
+            {
+                re.Add(static_cast<T>(reTerms[i].value_) * moments[reTerms[i].col_]);
+            }
+
+            for (int i = imRows[row]; i < imRows[row + 1]; ++i)
+            {
+                im.Add(-(static_cast<T>(imTerms[i].value_) * moments[imTerms[i].col_]));
+            }
+
+            zernikeMoments_[row] = ComplexT(re.Get(), im.Get()) * three_quarters_div_pi;
+        }
+    }
+
+    /**
+ * Computes the Zernike moments of _batchSize objects in one pass over the
+ * coefficients, see ZernikeMoments::ComputeBatch() for the layout of _moments.
+ */
+    static void ComputeBatch(const T * _moments, std::size_t _batchSize, FixedZernikeMoments * const * _zms)
+    {
+        constexpr T three_quarters_div_pi = boost::math::constants::three_quarters<T>() * 1 / boost::math::constants::pi<T>();
+
+        const int * reRows = BasisT::RealRowOffsets();
+        const FixedZernikeTerm * reTerms = BasisT::RealTerms();
+        const int * imRows = BasisT::ImagRowOffsets();
+        const FixedZernikeTerm * imTerms = BasisT::ImagTerms();
+
+        std::vector<MomentSum<T> > re(_batchSize), im(_batchSize);
+
+        for (int row = 0; row < BasisT::rowCount; ++row)
+        {
+            std::fill(re.begin(), re.end(), MomentSum<T>());
+            std::fill(im.begin(), im.end(), MomentSum<T>());
+
+            for (int i = reRows[row]; i < reRows[row + 1]; ++i)
+            {
+                const T value = static_cast<T>(reTerms[i].value_);
+                const T * moments = _moments + reTerms[i].col_ * _batchSize;
+
+                for (std::size_t b = 0; b < _batchSize; ++b)
+                {
+                    re[b].Add(value * moments[b]);
+                }
+            }
+
+            for (int i = imRows[row]; i < imRows[row + 1]; ++i)
+            {
+                const T value = static_cast<T>(imTerms[i].value_);
+                const T * moments = _moments + imTerms[i].col_ * _batchSize;
+
+                for (std::size_t b = 0; b < _batchSize; ++b)
+                {
+                    im[b].Add(-(value * moments[b]));
+                }
+            }
+
+            for (std::size_t b = 0; b < _batchSize; ++b)
+            {
+                _zms[b]->zernikeMoments_[row] = ComplexT(re[b].Get(), im[b].Get()) * three_quarters_div_pi;
+            }
+        }
+    }
+
+    inline ComplexT GetMoment(int _n, int _l, int _m) const
+    {
+        if (_m >= 0)
+        {
+            return zernikeMoments_[RowIndex(_n, _l, _m)];
+        }
+        else
+        {
+            T sign = (_m % 2) ? static_cast<T>(-1) : static_cast<T>(1);
+
+            return sign * std::conj(zernikeMoments_[RowIndex(_n, _l, -_m)]);
+        }
+    }
+
+private:
+    // ---- private attributes -----
+    std::array<ComplexT, RowIndex(N + 1, 0, 0)>  zernikeMoments_;    // nomen est omen
+};
@@ -0,0 +1,750 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#pragma once
+
+#include <atomic>
+#include <type_traits>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define ZERNIKE_SIMD_X86 1
+#define ZERNIKE_TARGET(features)
+#include <intrin.h>
+#include <immintrin.h>
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define ZERNIKE_SIMD_X86 1
+#define ZERNIKE_TARGET(features) __attribute__((target(features)))
+#include <immintrin.h>
+#endif
+
+/**
+ * Instruction sets of the inner loops of ScaledGeometricalMoments, see MomentKernels.
+ */
+enum class SimdLevel
+{
+    scalar = 0,
+    avx2 = 1,
+    avx512 = 2
+};
+
+inline const char * GetSimdLevelName(SimdLevel _level)
+{
+    switch (_level)
+    {
+        case SimdLevel::avx2: return "avx2";
+        case SimdLevel::avx512: return "avx512";
+        default: return "scalar";
+    }
+}
+
+/**
+ * The best level supported by the CPU and the operating system.
+ */
+inline SimdLevel DetectSimdLevel()
+{
+#if defined(ZERNIKE_SIMD_X86) && defined(_MSC_VER)
+    static const SimdLevel level = []()
+    {
+        int info[4];
+
+        __cpuid(info, 0);
+
+        if (info[0] < 7)
+        {
+            return SimdLevel::scalar;
+        }
+
+        __cpuid(info, 1);
+
+        // OSXSAVE, AVX and FMA
+        const int avxBits = (1 << 27) | (1 << 28) | (1 << 12);
+
+        if ((info[2] & avxBits) != avxBits)
+        {
+            return SimdLevel::scalar;
+        }
+
+        unsigned long long xcr0 = _xgetbv(0);
+
+        __cpuidex(info, 7, 0);
+
+        if ((xcr0 & 0x06) != 0x06 || !(info[1] & (1 << 5)))
+        {
+            return SimdLevel::scalar;
+        }
+
+        return ((xcr0 & 0xe6) == 0xe6 && (info[1] & (1 << 16))) ? SimdLevel::avx512 : SimdLevel::avx2;
+    }();
+
+    return level;
+#elif defined(ZERNIKE_SIMD_X86)
+    static const SimdLevel level = []()
+    {
+        __builtin_cpu_init();
+
+        if (__builtin_cpu_supports("avx512f"))
+        {
+            return SimdLevel::avx512;
+        }
+
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        {
+            return SimdLevel::avx2;
+        }
+
+        return SimdLevel::scalar;
+    }();
+
+    return level;
+#else
+    return SimdLevel::scalar;
+#endif
+}
+
+namespace moment_kernels_detail
+{
+    inline std::atomic<int> & SelectedLevel()
+    {
+        static std::atomic<int> level(static_cast<int>(DetectSimdLevel()));
+        return level;
+    }
+}
+
+/**
+ * Limits the level used by all later computations of the moments, e.g. to
+ * compare the kernels. Returns the level actually used, which is never higher
+ * than DetectSimdLevel().
+ */
+inline SimdLevel SelectSimdLevel(SimdLevel _level)
+{
+    SimdLevel level = static_cast<int>(_level) < static_cast<int>(DetectSimdLevel()) ? _level : DetectSimdLevel();
+
+    moment_kernels_detail::SelectedLevel() = static_cast<int>(level);
+
+    return level;
+}
+
+/// The level used to compute the moments, DetectSimdLevel() unless limited by SelectSimdLevel()
+inline SimdLevel GetSimdLevel()
+{
+    return static_cast<SimdLevel>(moment_kernels_detail::SelectedLevel().load());
+}
+
+/**
+ * Accumulator of the reductions of the moments. Types narrower than double
+ * are summed in double, so the float path loses only the precision of the
+ * stored values and not of the sums. The float SIMD kernels keep float lanes
+ * and compensate every lane instead (Kahan). Other types are summed directly.
+ */
+template<class T, bool widened = (sizeof(T) < sizeof(double))>
+class MomentSum
+{
+public:
+    void Add(T _value)
+    {
+        sum_ += _value;
+    }
+
+    T Get() const
+    {
+        return sum_;
+    }
+
+private:
+    T sum_{ 0 };
+};
+
+template<class T>
+class MomentSum<T, true>
+{
+public:
+    void Add(T _value)
+    {
+        sum_ += static_cast<double>(_value);
+    }
+
+    T Get() const
+    {
+        return static_cast<T>(sum_);
+    }
+
+private:
+    double sum_{ 0 };
+};
+
+namespace moment_kernels_detail
+{
+    template<class T>
+    T MultiplyScalar(T * _diff, const T * _samples, int _dim)
+    {
+        MomentSum<T> sum;
+        for (int i = 0; i < _dim; ++i)
+        {
+            _diff[i] *= _samples[i];
+            sum.Add(_diff[i]);
+        }
+
+        return sum.Get();
+    }
+
+    template<class T>
+    void DiffScalar(const T * _values, T * _diff, int _dim)
+    {
+        _diff[0] = -_values[0];
+        for (int i = 1; i < _dim; ++i)
+        {
+            _diff[i] = _values[i - 1] - _values[i];
+        }
+        _diff[_dim] = _values[_dim - 1];
+    }
+
+    /**
+ * The kernels of LaneKernels work on rows whose elements are vectors of Lanes
+ * values, one per object: the value of lane l of element i is at [i * Lanes + l].
+ */
+    template<class T, int Lanes>
+    void MultiplyLanesScalar(T * _diff, const T * _samples, int _dim, int _rows, T * _sums)
+    {
+        for (int row = 0; row < _rows; ++row, _diff += _dim * Lanes)
+        {
+            MomentSum<T> sums[Lanes];
+
+            for (int i = 0; i < _dim; ++i)
+            {
+                for (int lane = 0; lane < Lanes; ++lane)
+                {
+                    _diff[i * Lanes + lane] *= _samples[i * Lanes + lane];
+                    sums[lane].Add(_diff[i * Lanes + lane]);
+                }
+            }
+
+            for (int lane = 0; lane < Lanes; ++lane)
+            {
+                _sums[row * Lanes + lane] = sums[lane].Get();
+            }
+        }
+    }
+
+    template<class T, int Lanes>
+    void DiffLanesScalar(const T * _values, T * _diff, int _dim, int _rows)
+    {
+        for (int row = 0; row < _rows; ++row, _values += _dim * Lanes, _diff += (_dim + 1) * Lanes)
+        {
+            for (int lane = 0; lane < Lanes; ++lane)
+            {
+                _diff[lane] = -_values[lane];
+                _diff[_dim * Lanes + lane] = _values[(_dim - 1) * Lanes + lane];
+            }
+
+            for (int i = 1; i < _dim; ++i)
+            {
+                for (int lane = 0; lane < Lanes; ++lane)
+                {
+                    _diff[i * Lanes + lane] = _values[(i - 1) * Lanes + lane] - _values[i * Lanes + lane];
+                }
+            }
+        }
+    }
+
+#ifdef ZERNIKE_SIMD_X86
+    ZERNIKE_TARGET("avx2,fma")
+    inline double MultiplyAvx2(double * _diff, const double * _samples, int _dim)
+    {
+        __m256d sum = _mm256_setzero_pd();
+        int i = 0;
+
+        for (; i + 4 <= _dim; i += 4)
+        {
+            __m256d product = _mm256_mul_pd(_mm256_loadu_pd(_diff + i), _mm256_loadu_pd(_samples + i));
+            _mm256_storeu_pd(_diff + i, product);
+            sum = _mm256_add_pd(sum, product);
+        }
+
+        __m128d half = _mm_add_pd(_mm256_castpd256_pd128(sum), _mm256_extractf128_pd(sum, 1));
+        double result = _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+
+        return result + MultiplyScalar(_diff + i, _samples + i, _dim - i);
+    }
+
+    ZERNIKE_TARGET("avx2,fma")
+    inline float MultiplyAvx2(float * _diff, const float * _samples, int _dim)
+    {
+        // compensated sums per lane, float lanes are twice as many as double lanes
+        __m256 sum = _mm256_setzero_ps();
+        __m256 compensation = _mm256_setzero_ps();
+        int i = 0;
+
+        for (; i + 8 <= _dim; i += 8)
+        {
+            __m256 product = _mm256_mul_ps(_mm256_loadu_ps(_diff + i), _mm256_loadu_ps(_samples + i));
+            _mm256_storeu_ps(_diff + i, product);
+
+            __m256 value = _mm256_sub_ps(product, compensation);
+            __m256 next = _mm256_add_ps(sum, value);
+            compensation = _mm256_sub_ps(_mm256_sub_ps(next, sum), value);
+            sum = next;
+        }
+
+        // the lanes are added pairwise
+        sum = _mm256_sub_ps(sum, compensation);
+
+        __m128 quarter = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+        quarter = _mm_add_ps(quarter, _mm_movehl_ps(quarter, quarter));
+        float result = _mm_cvtss_f32(_mm_add_ss(quarter, _mm_movehdup_ps(quarter)));
+
+        return result + MultiplyScalar(_diff + i, _samples + i, _dim - i);
+    }
+
+    ZERNIKE_TARGET("avx2,fma")
+    inline void DiffAvx2(const double * _values, double * _diff, int _dim)
+    {
+        _diff[0] = -_values[0];
+        int i = 1;
+
+        for (; i + 4 <= _dim; i += 4)
+        {
+            _mm256_storeu_pd(_diff + i, _mm256_sub_pd(_mm256_loadu_pd(_values + i - 1), _mm256_loadu_pd(_values + i)));
+        }
+
+        for (; i < _dim; ++i)
+        {
+            _diff[i] = _values[i - 1] - _values[i];
+        }
+        _diff[_dim] = _values[_dim - 1];
+    }
+
+    ZERNIKE_TARGET("avx2,fma")
+    inline void DiffAvx2(const float * _values, float * _diff, int _dim)
+    {
+        _diff[0] = -_values[0];
+        int i = 1;
+
+        for (; i + 8 <= _dim; i += 8)
+        {
+            _mm256_storeu_ps(_diff + i, _mm256_sub_ps(_mm256_loadu_ps(_values + i - 1), _mm256_loadu_ps(_values + i)));
+        }
+
+        for (; i < _dim; ++i)
+        {
+            _diff[i] = _values[i - 1] - _values[i];
+        }
+        _diff[_dim] = _values[_dim - 1];
+    }
+
+    ZERNIKE_TARGET("avx512f")
+    inline double MultiplyAvx512(double * _diff, const double * _samples, int _dim)
+    {
+        __m512d sum = _mm512_setzero_pd();
+        int i = 0;
+
+        for (; i + 8 <= _dim; i += 8)
+        {
+            __m512d product = _mm512_mul_pd(_mm512_loadu_pd(_diff + i), _mm512_loadu_pd(_samples + i));
+            _mm512_storeu_pd(_diff + i, product);
+            sum = _mm512_add_pd(sum, product);
+        }
+
+        if (i < _dim)
+        {
+            __mmask8 mask = static_cast<__mmask8>((1u << (_dim - i)) - 1);
+            __m512d product = _mm512_mul_pd(_mm512_maskz_loadu_pd(mask, _diff + i), _mm512_maskz_loadu_pd(mask, _samples + i));
+            _mm512_mask_storeu_pd(_diff + i, mask, product);
+            sum = _mm512_add_pd(sum, product);
+        }
+
+        // _mm512_reduce_add_pd() triggers false uninitialized warnings in GCC
+        double lanes[8];
+        _mm512_storeu_pd(lanes, sum);
+
+        return ((lanes[0] + lanes[4]) + (lanes[2] + lanes[6])) + ((lanes[1] + lanes[5]) + (lanes[3] + lanes[7]));
+    }
+
+    /// Kahan summation per lane
+    ZERNIKE_TARGET("avx512f")
+    inline void AddCompensatedAvx512(__m512 & _sum, __m512 & _compensation, __m512 _value)
+    {
+        __m512 value = _mm512_sub_ps(_value, _compensation);
+        __m512 sum = _mm512_add_ps(_sum, value);
+
+        _compensation = _mm512_sub_ps(_mm512_sub_ps(sum, _sum), value);
+        _sum = sum;
+    }
+
+    ZERNIKE_TARGET("avx512f")
+    inline float MultiplyAvx512(float * _diff, const float * _samples, int _dim)
+    {
+        __m512 sum = _mm512_setzero_ps();
+        __m512 compensation = _mm512_setzero_ps();
+        int i = 0;
+
+        for (; i + 16 <= _dim; i += 16)
+        {
+            __m512 product = _mm512_mul_ps(_mm512_loadu_ps(_diff + i), _mm512_loadu_ps(_samples + i));
+            _mm512_storeu_ps(_diff + i, product);
+            AddCompensatedAvx512(sum, compensation, product);
+        }
+
+        if (i < _dim)
+        {
+            __mmask16 mask = static_cast<__mmask16>((1u << (_dim - i)) - 1);
+            __m512 product = _mm512_mul_ps(_mm512_maskz_loadu_ps(mask, _diff + i), _mm512_maskz_loadu_ps(mask, _samples + i));
+            _mm512_mask_storeu_ps(_diff + i, mask, product);
+            AddCompensatedAvx512(sum, compensation, product);
+        }
+
+        float lanes[16];
+        _mm512_storeu_ps(lanes, _mm512_sub_ps(sum, compensation));
+
+        // the lanes are added pairwise
+        for (int width = 8; width > 0; width /= 2)
+        {
+            for (int lane = 0; lane < width; ++lane)
+            {
+                lanes[lane] += lanes[lane + width];
+            }
+        }
+
+        return lanes[0];
+    }
+
+    ZERNIKE_TARGET("avx512f")
+    inline void DiffAvx512(const double * _values, double * _diff, int _dim)
+    {
+        _diff[0] = -_values[0];
+        int i = 1;
+
+        for (; i + 8 <= _dim; i += 8)
+        {
+            _mm512_storeu_pd(_diff + i, _mm512_sub_pd(_mm512_loadu_pd(_values + i - 1), _mm512_loadu_pd(_values + i)));
+        }
+
+        if (i < _dim)
+        {
+            __mmask8 mask = static_cast<__mmask8>((1u << (_dim - i)) - 1);
+            _mm512_mask_storeu_pd(_diff + i, mask, _mm512_sub_pd(_mm512_maskz_loadu_pd(mask, _values + i - 1), _mm512_maskz_loadu_pd(mask, _values + i)));
+        }
+        _diff[_dim] = _values[_dim - 1];
+    }
+
+    ZERNIKE_TARGET("avx512f")
+    inline void DiffAvx512(const float * _values, float * _diff, int _dim)
+    {
+        _diff[0] = -_values[0];
+        int i = 1;
+
+        for (; i + 16 <= _dim; i += 16)
+        {
+            _mm512_storeu_ps(_diff + i, _mm512_sub_ps(_mm512_loadu_ps(_values + i - 1), _mm512_loadu_ps(_values + i)));
+        }
+
+        if (i < _dim)
+        {
+            __mmask16 mask = static_cast<__mmask16>((1u << (_dim - i)) - 1);
+            _mm512_mask_storeu_ps(_diff + i, mask, _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, _values + i - 1), _mm512_maskz_loadu_ps(mask, _values + i)));
+        }
+        _diff[_dim] = _values[_dim - 1];
+    }
+
+    // lane kernels, a lane vector is one register
+
+    ZERNIKE_TARGET("avx2,fma")
+    inline void MultiplyLanesAvx2(double * _diff, const double * _samples, int _dim, int _rows, double * _sums)
+    {
+        for (int row = 0; row < _rows; ++row, _diff += _dim * 4)
+        {
+            __m256d sum = _mm256_setzero_pd();
+
+            for (int i = 0; i < _dim; ++i)
+            {
+                __m256d product = _mm256_mul_pd(_mm256_loadu_pd(_diff + i * 4), _mm256_loadu_pd(_samples + i * 4));
+                _mm256_storeu_pd(_diff + i * 4, product);
+                sum = _mm256_add_pd(sum, product);
+            }
+
+            _mm256_storeu_pd(_sums + row * 4, sum);
+        }
+    }
+
+    ZERNIKE_TARGET("avx2,fma")
+    inline void AddCompensatedAvx2(__m256 & _sum, __m256 & _compensation, __m256 _value)
+    {
+        __m256 value = _mm256_sub_ps(_value, _compensation);
+        __m256 sum = _mm256_add_ps(_sum, value);
+
+        _compensation = _mm256_sub_ps(_mm256_sub_ps(sum, _sum), value);
+        _sum = sum;
+    }
+
+    ZERNIKE_TARGET("avx2,fma")
+    inline void MultiplyLanesAvx2(float * _diff, const float * _samples, int _dim, int _rows, float * _sums)
+    {
+        for (int row = 0; row < _rows; ++row, _diff += _dim * 8)
+        {
+            __m256 sum = _mm256_setzero_ps();
+            __m256 compensation = _mm256_setzero_ps();
+
+            for (int i = 0; i < _dim; ++i)
+            {
+                __m256 product = _mm256_mul_ps(_mm256_loadu_ps(_diff + i * 8), _mm256_loadu_ps(_samples + i * 8));
+                _mm256_storeu_ps(_diff + i * 8, product);
+                AddCompensatedAvx2(sum, compensation, product);
+            }
+
+            _mm256_storeu_ps(_sums + row * 8, _mm256_sub_ps(sum, compensation));
+        }
+    }
+
+    ZERNIKE_TARGET("avx2,fma")
+    inline void DiffLanesAvx2(const double * _values, double * _diff, int _dim, int _rows)
+    {
+        for (int row = 0; row < _rows; ++row, _values += _dim * 4, _diff += (_dim + 1) * 4)
+        {
+            _mm256_storeu_pd(_diff, _mm256_sub_pd(_mm256_setzero_pd(), _mm256_loadu_pd(_values)));
+
+            for (int i = 1; i < _dim; ++i)
+            {
+                _mm256_storeu_pd(_diff + i * 4, _mm256_sub_pd(_mm256_loadu_pd(_values + (i - 1) * 4), _mm256_loadu_pd(_values + i * 4)));
+            }
+
+            _mm256_storeu_pd(_diff + _dim * 4, _mm256_loadu_pd(_values + (_dim - 1) * 4));
+        }
+    }
+
+    ZERNIKE_TARGET("avx2,fma")
+    inline void DiffLanesAvx2(const float * _values, float * _diff, int _dim, int _rows)
+    {
+        for (int row = 0; row < _rows; ++row, _values += _dim * 8, _diff += (_dim + 1) * 8)
+        {
+            _mm256_storeu_ps(_diff, _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(_values)));
+
+            for (int i = 1; i < _dim; ++i)
+            {
+                _mm256_storeu_ps(_diff + i * 8, _mm256_sub_ps(_mm256_loadu_ps(_values + (i - 1) * 8), _mm256_loadu_ps(_values + i * 8)));
+            }
+
+            _mm256_storeu_ps(_diff + _dim * 8, _mm256_loadu_ps(_values + (_dim - 1) * 8));
+        }
+    }
+
+    ZERNIKE_TARGET("avx512f")
+    inline void MultiplyLanesAvx512(double * _diff, const double * _samples, int _dim, int _rows, double * _sums)
+    {
+        for (int row = 0; row < _rows; ++row, _diff += _dim * 8)
+        {
+            __m512d sum = _mm512_setzero_pd();
+
+            for (int i = 0; i < _dim; ++i)
+            {
+                __m512d product = _mm512_mul_pd(_mm512_loadu_pd(_diff + i * 8), _mm512_loadu_pd(_samples + i * 8));
+                _mm512_storeu_pd(_diff + i * 8, product);
+                sum = _mm512_add_pd(sum, product);
+            }
+
+            _mm512_storeu_pd(_sums + row * 8, sum);
+        }
+    }
+
+    ZERNIKE_TARGET("avx512f")
+    inline void MultiplyLanesAvx512(float * _diff, const float * _samples, int _dim, int _rows, float * _sums)
+    {
+        for (int row = 0; row < _rows; ++row, _diff += _dim * 16)
+        {
+            __m512 sum = _mm512_setzero_ps();
+            __m512 compensation = _mm512_setzero_ps();
+
+            for (int i = 0; i < _dim; ++i)
+            {
+                __m512 product = _mm512_mul_ps(_mm512_loadu_ps(_diff + i * 16), _mm512_loadu_ps(_samples + i * 16));
+                _mm512_storeu_ps(_diff + i * 16, product);
+                AddCompensatedAvx512(sum, compensation, product);
+            }
+
+            _mm512_storeu_ps(_sums + row * 16, _mm512_sub_ps(sum, compensation));
+        }
+    }
+
+    ZERNIKE_TARGET("avx512f")
+    inline void DiffLanesAvx512(const double * _values, double * _diff, int _dim, int _rows)
+    {
+        for (int row = 0; row < _rows; ++row, _values += _dim * 8, _diff += (_dim + 1) * 8)
+        {
+            _mm512_storeu_pd(_diff, _mm512_sub_pd(_mm512_setzero_pd(), _mm512_loadu_pd(_values)));
+
+            for (int i = 1; i < _dim; ++i)
+            {
+                _mm512_storeu_pd(_diff + i * 8, _mm512_sub_pd(_mm512_loadu_pd(_values + (i - 1) * 8), _mm512_loadu_pd(_values + i * 8)));
+            }
+
+            _mm512_storeu_pd(_diff + _dim * 8, _mm512_loadu_pd(_values + (_dim - 1) * 8));
+        }
+    }
+
+    ZERNIKE_TARGET("avx512f")
+    inline void DiffLanesAvx512(const float * _values, float * _diff, int _dim, int _rows)
+    {
+        for (int row = 0; row < _rows; ++row, _values += _dim * 16, _diff += (_dim + 1) * 16)
+        {
+            _mm512_storeu_ps(_diff, _mm512_sub_ps(_mm512_setzero_ps(), _mm512_loadu_ps(_values)));
+
+            for (int i = 1; i < _dim; ++i)
+            {
+                _mm512_storeu_ps(_diff + i * 16, _mm512_sub_ps(_mm512_loadu_ps(_values + (i - 1) * 16), _mm512_loadu_ps(_values + i * 16)));
+            }
+
+            _mm512_storeu_ps(_diff + _dim * 16, _mm512_loadu_ps(_values + (_dim - 1) * 16));
+        }
+    }
+#endif
+}
+
+/**
+ * The inner loops of ScaledGeometricalMoments::Compute():
+ *   multiply_  multiplies _diff[0.._dim-1] in place by _samples and returns the sum,
+ *   diff_      stores the differences of _values[0.._dim-1] into _diff[0.._dim].
+ * SIMD versions exist for float and double on x86, other types and CPUs use
+ * the scalar loops. The scalar loops give the same results as before, the SIMD
+ * versions sum in a different order. The float sums are widened or compensated,
+ * see MomentSum.
+ */
+template<class T>
+struct MomentKernels
+{
+    typedef T (*MultiplyFunction)(T * _diff, const T * _samples, int _dim);
+    typedef void (*DiffFunction)(const T * _values, T * _diff, int _dim);
+
+    MultiplyFunction    multiply_;
+    DiffFunction        diff_;
+    SimdLevel           level_;
+
+    /// Kernels of the given level, or of the highest lower level available for T and the CPU
+    static MomentKernels Get(SimdLevel _level)
+    {
+        if (static_cast<int>(_level) > static_cast<int>(DetectSimdLevel()))
+        {
+            _level = DetectSimdLevel();
+        }
+
+        return Select(_level, static_cast<T *>(nullptr));
+    }
+
+    /// Kernels of GetSimdLevel()
+    static MomentKernels Get()
+    {
+        return Get(GetSimdLevel());
+    }
+
+private:
+    template<class U>
+    static MomentKernels Select(SimdLevel, U *)
+    {
+        return MomentKernels{ &moment_kernels_detail::MultiplyScalar<T>, &moment_kernels_detail::DiffScalar<T>, SimdLevel::scalar };
+    }
+
+#ifdef ZERNIKE_SIMD_X86
+    static MomentKernels SelectSimd(SimdLevel _level)
+    {
+        using namespace moment_kernels_detail;
+
+        switch (_level)
+        {
+            case SimdLevel::avx512:
+                return MomentKernels{ static_cast<MultiplyFunction>(&MultiplyAvx512), static_cast<DiffFunction>(&DiffAvx512), SimdLevel::avx512 };
+            case SimdLevel::avx2:
+                return MomentKernels{ static_cast<MultiplyFunction>(&MultiplyAvx2), static_cast<DiffFunction>(&DiffAvx2), SimdLevel::avx2 };
+            default:
+                return MomentKernels{ &MultiplyScalar<T>, &DiffScalar<T>, SimdLevel::scalar };
+        }
+    }
+
+    static MomentKernels Select(SimdLevel _level, double *)
+    {
+        return SelectSimd(_level);
+    }
+
+    static MomentKernels Select(SimdLevel _level, float *)
+    {
+        return SelectSimd(_level);
+    }
+#endif
+};
+
+/**
+ * The inner loops of ScaledGeometricalMoments::InitLanes(), which computes the
+ * moments of lanes_ grids at once, one grid per SIMD lane. The rows of the
+ * kernels consist of vectors of lanes_ values, see MultiplyLanesScalar():
+ *   multiply_  multiplies _rows rows of _dim vectors in place by _samples and stores the sums of every row into _sums,
+ *   diff_      stores the differences of _rows rows of _dim vectors into rows of _dim + 1 vectors.
+ * A lane vector fills a register of the level, so the loops over a row have
+ * no horizontal sums. The scalar level keeps the lanes of avx2.
+ */
+template<class T>
+struct LaneKernels
+{
+    typedef void (*MultiplyFunction)(T * _diff, const T * _samples, int _dim, int _rows, T * _sums);
+    typedef void (*DiffFunction)(const T * _values, T * _diff, int _dim, int _rows);
+
+    MultiplyFunction    multiply_;
+    DiffFunction        diff_;
+    int                 lanes_;
+    SimdLevel           level_;
+
+    /// Kernels of the given level, or of the highest lower level available for T and the CPU
+    static LaneKernels Get(SimdLevel _level)
+    {
+        if (static_cast<int>(_level) > static_cast<int>(DetectSimdLevel()))
+        {
+            _level = DetectSimdLevel();
+        }
+
+        return Select(_level, static_cast<T *>(nullptr));
+    }
+
+    /// Kernels of GetSimdLevel()
+    static LaneKernels Get()
+    {
+        return Get(GetSimdLevel());
+    }
+
+private:
+    static constexpr int scalarLanes = sizeof(T) >= 32 ? 1 : static_cast<int>(32 / sizeof(T));
+
+    static LaneKernels Scalar()
+    {
+        using namespace moment_kernels_detail;
+
+        return LaneKernels{ &MultiplyLanesScalar<T, scalarLanes>, &DiffLanesScalar<T, scalarLanes>, scalarLanes, SimdLevel::scalar };
+    }
+
+    template<class U>
+    static LaneKernels Select(SimdLevel, U *)
+    {
+        return Scalar();
+    }
+
+#ifdef ZERNIKE_SIMD_X86
+    static LaneKernels SelectSimd(SimdLevel _level)
+    {
+        using namespace moment_kernels_detail;
+
+        switch (_level)
+        {
+            case SimdLevel::avx512:
+                return LaneKernels{ static_cast<MultiplyFunction>(&MultiplyLanesAvx512), static_cast<DiffFunction>(&DiffLanesAvx512), static_cast<int>(64 / sizeof(T)), SimdLevel::avx512 };
+            case SimdLevel::avx2:
+                return LaneKernels{ static_cast<MultiplyFunction>(&MultiplyLanesAvx2), static_cast<DiffFunction>(&DiffLanesAvx2), static_cast<int>(32 / sizeof(T)), SimdLevel::avx2 };
+            default:
+                return Scalar();
+        }
+    }
+
+    static LaneKernels Select(SimdLevel _level, double *)
+    {
+        return SelectSimd(_level);
+    }
+
+    static LaneKernels Select(SimdLevel _level, float *)
+    {
+        return SelectSimd(_level);
+    }
+#endif
+};
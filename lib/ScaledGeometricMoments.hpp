@@ -41,10 +41,142 @@ for more information, see the paper:
 
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
 #include <vector>
 
+#include "BinomialTable.hpp"
+#include "BitVoxelGrid.hpp"
+#include "BrickVoxelGrid.hpp"
+#include "MomentKernels.hpp"
+#include "ThreadPool.hpp"
+#include "VoxelSegments.hpp"
+
 using std::vector;
 
+/**
+ * Index of the moment of order (i,j,k) in the flat moment array. The moments
+ * are ordered by the total order i+j+k, then by i and j, so the index does not
+ * depend on the maximal order and a prefix of the array holds all moments of
+ * a lower maximal order.
+ */
+inline constexpr std::size_t GeometricalMomentIndex(int _i, int _j, int _k)
+{
+    return static_cast<std::size_t>((_i + _j + _k) * (_i + _j + _k + 1) * (_i + _j + _k + 2) / 6
+        + _i * (_i + _j + _k + 1) - _i * (_i - 1) / 2 + _j);
+}
+
+/// Number of the moments with i+j+k <= _maxOrder
+inline constexpr std::size_t GeometricalMomentCount(int _maxOrder)
+{
+    return static_cast<std::size_t>((_maxOrder + 1) * (_maxOrder + 2) * (_maxOrder + 3) / 6);
+}
+
+/// Inverse of GeometricalMomentIndex()
+inline void GeometricalMomentOrder(std::size_t _index, int & _i, int & _j, int & _k)
+{
+    int order = 0;
+
+    while (GeometricalMomentCount(order) <= _index)
+    {
+        ++order;
+    }
+
+    std::size_t rest = _index - (order > 0 ? GeometricalMomentCount(order - 1) : 0);
+
+    _i = 0;
+
+    while (rest > static_cast<std::size_t>(order - _i))
+    {
+        rest -= order - _i + 1;
+        ++_i;
+    }
+
+    _j = static_cast<int>(rest);
+    _k = order - _i - _j;
+}
+
+/**
+ * A box of a dense voxel grid: the voxels (x, y, z) with x in [x_, x_ + xSize_),
+ * y in [y_, y_ + ySize_) and z in [z_, z_ + zSize_), see FindOccupiedBox().
+ */
+struct VoxelBox
+{
+    int x_, y_, z_;                 // first voxel of the box
+    int xSize_, ySize_, zSize_;     // size of the box
+};
+
+/**
+ * The tight box around the nonzero voxels of a dense grid with the index
+ * (z * _yDim + y) * _xDim + x. A line is scanned from both ends up to its
+ * first and last nonzero voxel, so the grid is read at most once. The box of
+ * an empty grid is the whole grid.
+ */
+template<class InputVoxelIterator>
+VoxelBox FindOccupiedBox(InputVoxelIterator _voxels, int _xDim, int _yDim, int _zDim)
+{
+    using VoxelType = typename std::iterator_traits<InputVoxelIterator>::value_type;
+
+    int xBegin = _xDim, xEnd = 0, yBegin = _yDim, yEnd = 0, zBegin = _zDim, zEnd = 0;
+
+    for (int z = 0; z < _zDim; ++z)
+    {
+        for (int y = 0; y < _yDim; ++y)
+        {
+            InputVoxelIterator line{ _voxels };
+            line += (static_cast<std::ptrdiff_t>(z) * _yDim + y) * _xDim;
+
+            int first = 0;
+
+            while (first < _xDim && line[first] == static_cast<VoxelType>(0))
+            {
+                ++first;
+            }
+
+            if (first == _xDim)
+            {
+                continue;
+            }
+
+            int last = _xDim - 1;
+
+            while (line[last] == static_cast<VoxelType>(0))
+            {
+                --last;
+            }
+
+            xBegin = std::min(xBegin, first);
+            xEnd = std::max(xEnd, last + 1);
+            yBegin = std::min(yBegin, y);
+            yEnd = std::max(yEnd, y + 1);
+            zBegin = std::min(zBegin, z);
+            zEnd = z + 1;
+        }
+    }
+
+    if (xBegin >= xEnd)
+    {
+        return VoxelBox{ 0, 0, 0, _xDim, _yDim, _zDim };
+    }
+
+    return VoxelBox{ xBegin, yBegin, zBegin, xEnd - xBegin, yEnd - yBegin, zEnd - zBegin };
+}
+
+/**
+ * Algorithms of ScaledGeometricalMoments. All give the same moments up to
+ * rounding.
+ */
+enum class GeometricalMomentsEngine
+{
+    diff,           ///< difference grids multiplied by the samples, one pass over the grid per order
+    contraction,    ///< per-axis power tables contracted slab by slab, one pass over the voxels
+    sparseDiff      ///< diff with only the nonzero entries of the x difference grid, cost ~ surface per order
+};
+
 /**
     Class for computing the scaled, pre-integrated geometrical moments.
     These tricks are needed to make the computation numerically stable.
@@ -85,10 +217,12 @@ public:
         double _yCOG,           /**< y-coord of the center of gravity */
         double _zCOG,           /**< z-coord of the center of gravity */
         double _scale,          /**< scaling factor */
-        int _maxOrder = 1       /**< maximal order to compute moments for */
+        int _maxOrder = 1,      /**< maximal order to compute moments for */
+        GeometricalMomentsEngine _engine = GeometricalMomentsEngine::diff,  /**< algorithm */
+        ThreadPool * _pool = nullptr    /**< threads for the z-slabs of the diff engines, none if nullptr */
     )
     {
-        Init(_voxels, _xDim, _yDim, _zDim, _xCOG, _yCOG, _zCOG, _scale, _maxOrder);
+        Init(_voxels, _xDim, _yDim, _zDim, _xCOG, _yCOG, _zCOG, _scale, _maxOrder, _engine, _pool);
     }
 
     /// Default constructor
@@ -104,30 +238,528 @@ public:
         double _yCOG,           /**< y-coord of the center of gravity */
         double _zCOG,           /**< z-coord of the center of gravity */
         double _scale,          /**< scaling factor */
+        int _maxOrder = 1,      /**< maximal order to compute moments for */
+        GeometricalMomentsEngine _engine = GeometricalMomentsEngine::diff,  /**< algorithm */
+        ThreadPool * _pool = nullptr    /**< threads for the z-slabs of the diff engines, none if nullptr */
+    )
+    {
+        Init(_voxels, _xDim, _yDim, _zDim, VoxelBox{ 0, 0, 0, _xDim, _yDim, _zDim }, _xCOG, _yCOG, _zCOG, _scale, _maxOrder, _engine, _pool);
+    }
+
+    /**
+ * The same for the voxels of a box of the grid, the voxels outside the box
+ * must be zero, see FindOccupiedBox(). The samples of the box are the ones
+ * of the whole grid, so the moments equal the ones of the whole grid up to
+ * rounding, but the cost depends on the size of the box only.
+ */
+    void Init(
+        InputVoxelIterator _voxels,  /**< input voxel grid */
+        int _xDim,              /**< x-dimension of the input voxel grid */
+        int _yDim,              /**< y-dimension of the input voxel grid */
+        int _zDim,              /**< z-dimension of the input voxel grid */
+        const VoxelBox & _box,  /**< box of the grid with all nonzero voxels */
+        double _xCOG,           /**< x-coord of the center of gravity */
+        double _yCOG,           /**< y-coord of the center of gravity */
+        double _zCOG,           /**< z-coord of the center of gravity */
+        double _scale,          /**< scaling factor */
+        int _maxOrder = 1,      /**< maximal order to compute moments for */
+        GeometricalMomentsEngine _engine = GeometricalMomentsEngine::diff,  /**< algorithm */
+        ThreadPool * _pool = nullptr    /**< threads for the z-slabs of the diff engines, none if nullptr */
+    )
+    {
+        if (_box.x_ < 0 || _box.y_ < 0 || _box.z_ < 0 || _box.xSize_ < 0 || _box.ySize_ < 0 || _box.zSize_ < 0 ||
+            _box.x_ + _box.xSize_ > _xDim || _box.y_ + _box.ySize_ > _yDim || _box.z_ + _box.zSize_ > _zDim)
+        {
+            throw std::out_of_range("ScaledGeometricalMoments::Init(): the box is out of the grid.");
+        }
+
+        xDim_ = _box.xSize_;
+        yDim_ = _box.ySize_;
+        zDim_ = _box.zSize_;
+
+        origin_ = (static_cast<std::ptrdiff_t>(_box.z_) * _yDim + _box.y_) * _xDim + _box.x_;
+        lineStride_ = _xDim;
+        slabStride_ = static_cast<std::ptrdiff_t>(_xDim) * _yDim;
+
+        maxOrder_ = _maxOrder;
+
+        moments_.resize(GeometricalMomentCount(maxOrder_));
+
+        ComputeSamples(_xCOG, _yCOG, _zCOG, _scale, _box.x_, _box.y_, _box.z_);
+
+        if (_engine == GeometricalMomentsEngine::contraction)
+        {
+            ComputeContraction(_voxels);
+        }
+        else
+        {
+            Compute(_voxels, _engine == GeometricalMomentsEngine::sparseDiff, _pool);
+        }
+    }
+
+    /**
+ * Computes the moments of a binary grid given as segments along y, see
+ * VoxelSegments. The cost depends on the number of segments, not on dim^3.
+ */
+    void InitFromSegments(
+        const VoxelSegments & _segments,   /**< input voxel grid */
+        double _xCOG,           /**< x-coord of the center of gravity */
+        double _yCOG,           /**< y-coord of the center of gravity */
+        double _zCOG,           /**< z-coord of the center of gravity */
+        double _scale,          /**< scaling factor */
         int _maxOrder = 1       /**< maximal order to compute moments for */
     )
     {
-        xDim_ = _xDim;
-        yDim_ = _yDim;
-        zDim_ = _zDim;
+        BeginSegments(_segments.GetDim(), _xCOG, _yCOG, _zCOG, _scale, _maxOrder);
+        AddSegments(_segments);
+        EndSegments();
+    }
+
+    /**
+ * Starts the moments of a segment grid which is given in parts, e.g. plane by
+ * plane while it is read from a file, see AddSegments() and EndSegments().
+ */
+    void BeginSegments(
+        int _dim,               /**< dimension of the voxel grid */
+        double _xCOG,           /**< x-coord of the center of gravity */
+        double _yCOG,           /**< y-coord of the center of gravity */
+        double _zCOG,           /**< z-coord of the center of gravity */
+        double _scale,          /**< scaling factor */
+        int _maxOrder = 1       /**< maximal order to compute moments for */
+    )
+    {
+        xDim_ = yDim_ = zDim_ = _dim;
 
         maxOrder_ = _maxOrder;
 
-        moments_.resize(maxOrder_ + 1);
+        moments_.assign(GeometricalMomentCount(maxOrder_), static_cast<T>(0));
+
+        ComputeSamples(_xCOG, _yCOG, _zCOG, _scale);
+
+        ComputeSegmentPowers();
+    }
+
+    /// Adds the moments of a part of the grid, the parts must not overlap
+    void AddSegments(const VoxelSegments & _segments)
+    {
+        ComputeSegments(_segments);
+    }
 
+    /// Completes the moments after the last AddSegments()
+    void EndSegments()
+    {
         for (int i = 0; i <= maxOrder_; ++i)
         {
-            moments_[i].resize(maxOrder_ - i + 1);
-
             for (int j = 0; j <= maxOrder_ - i; ++j)
             {
-                moments_[i][j].resize(maxOrder_ - i - j + 1);
+                for (int k = 0; k <= maxOrder_ - i - j; ++k)
+                {
+                    moments_[GeometricalMomentIndex(i, j, k)] /= static_cast<T>((1 + i) * (1 + j) * (1 + k));
+                }
             }
         }
 
+        for (auto & powers : segmentPowers_)
+        {
+            powers = T1D();
+        }
+    }
+
+    /**
+ * Computes the moments of a bit-packed binary grid with the sparse diff
+ * algorithm. The transitions along x are found with bit scans, see
+ * BitVoxelGrid::ForEachRun().
+ */
+    void InitFromBits(
+        const BitVoxelGrid & _grid,   /**< input voxel grid */
+        double _xCOG,           /**< x-coord of the center of gravity */
+        double _yCOG,           /**< y-coord of the center of gravity */
+        double _zCOG,           /**< z-coord of the center of gravity */
+        double _scale,          /**< scaling factor */
+        int _maxOrder = 1       /**< maximal order to compute moments for */
+    )
+    {
+        xDim_ = yDim_ = zDim_ = _grid.GetDim();
+
+        maxOrder_ = _maxOrder;
+
+        moments_.resize(GeometricalMomentCount(maxOrder_));
+
         ComputeSamples(_xCOG, _yCOG, _zCOG, _scale);
 
-        Compute(_voxels);
+        SparseDiff diff;
+        diff.offsets_.resize(_grid.GetLineCount() + 1);
+        diff.offsets_[0] = 0;
+
+        for (std::size_t p = 0; p < _grid.GetLineCount(); ++p)
+        {
+            // the diff function f(x-1) - f(x) is -1 at the begin and 1 at the end of a run
+            _grid.ForEachRun(p, [&diff](int _begin, int _end)
+            {
+                diff.positions_.push_back(_begin);
+                diff.values_.push_back(static_cast<T>(-1));
+                diff.positions_.push_back(_end);
+                diff.values_.push_back(static_cast<T>(1));
+            });
+
+            diff.offsets_[p + 1] = diff.values_.size();
+        }
+
+        ComputeFromDiff(nullptr, &diff, nullptr);
+    }
+
+    /**
+ * Computes the moments of a brick grid, see BrickVoxelGrid. A full brick is a
+ * box, its moments are the products of the sums along the three axes. All
+ * full bricks of a slab bx share the sums along x, so their sums along y and z
+ * are collected first and contracted with x once per slab, see AddFullBricks().
+ * The mixed bricks are taken plane by plane x as segments along y, so the lines
+ * and planes of the bricks of a slab are contracted together, see
+ * ComputeSegments(). Empty bricks cost nothing.
+ */
+    void InitFromBricks(
+        const BrickVoxelGrid & _grid,   /**< input voxel grid */
+        double _xCOG,           /**< x-coord of the center of gravity */
+        double _yCOG,           /**< y-coord of the center of gravity */
+        double _zCOG,           /**< z-coord of the center of gravity */
+        double _scale,          /**< scaling factor */
+        int _maxOrder = 1       /**< maximal order to compute moments for */
+    )
+    {
+        const int brickDim = BrickVoxelGrid::brickDim;
+        const int bricksPerEdge = _grid.GetBricksPerEdge();
+
+        BeginSegments(_grid.GetDim(), _xCOG, _yCOG, _zCOG, _scale, _maxOrder);
+
+        VoxelSegments plane(_grid.GetDim());
+        vector<std::size_t> mixed;      // mixed bricks of a slab bx, ordered by z and y
+
+        for (int bx = 0; bx < bricksPerEdge; ++bx)
+        {
+            mixed.clear();
+
+            AddFullBricks(_grid, bx, mixed);
+
+            for (int x = bx * brickDim; x < std::min((bx + 1) * brickDim, xDim_) && !mixed.empty(); ++x)
+            {
+                plane.Reset(_grid.GetDim());
+
+                // the bricks [first, last) of mixed have the same bz, their lines z are added in order
+                for (std::size_t first = 0, last = 0; first < mixed.size(); first = last)
+                {
+                    const std::size_t slab = mixed[first] / (static_cast<std::size_t>(bricksPerEdge) * bricksPerEdge);
+                    const int zOrigin = static_cast<int>(slab) * brickDim;
+
+                    last = first + 1;
+
+                    while (last < mixed.size() && mixed[last] / (static_cast<std::size_t>(bricksPerEdge) * bricksPerEdge) == slab)
+                    {
+                        ++last;
+                    }
+
+                    for (int z = zOrigin; z < std::min(zOrigin + brickDim, zDim_); ++z)
+                    {
+                        for (std::size_t b = first; b < last; ++b)
+                        {
+                            const int yOrigin = static_cast<int>(mixed[b] / bricksPerEdge % bricksPerEdge) * brickDim;
+
+                            BrickVoxelGrid::ForEachRun(_grid.GetMask(mixed[b]), x - bx * brickDim, z - zOrigin, [&](int _yBegin, int _yEnd)
+                            {
+                                plane.Add(x, z, yOrigin + _yBegin, yOrigin + _yEnd);
+                            });
+                        }
+                    }
+                }
+
+                ComputeSegments(plane);
+            }
+        }
+
+        EndSegments();
+    }
+
+    /**
+ * Takes the moments up to _maxOrder from an earlier computation, e.g. of a
+ * higher order, see GetMoments(). The moments of the orders up to _maxOrder
+ * come first in the array, so a longer array can be passed as well.
+ */
+    void InitFromMoments(
+        const T * _moments,     /**< moments in the order of GeometricalMomentIndex() */
+        int _maxOrder           /**< maximal order of the moments to take */
+    )
+    {
+        xDim_ = yDim_ = zDim_ = 0;
+
+        maxOrder_ = _maxOrder;
+
+        samples_.clear();
+        moments_.assign(_moments, _moments + GeometricalMomentCount(maxOrder_));
+    }
+
+    /// Center of gravity and scaling factor of a grid of InitLanes()
+    struct Placement
+    {
+        double xCOG_, yCOG_, zCOG_, scale_;
+    };
+
+    /**
+ * Computes the moments of _count grids of the same dimensions with the diff
+ * algorithm, LaneKernels::lanes_ grids at once with one grid per SIMD lane.
+ * The loops of a small grid are too short to fill the registers, so for many
+ * small grids the calls of the kernels and the horizontal sums dominate in
+ * Init(). Here the lanes are never added, and the stages along x and y of all
+ * orders run on one z-slab of the diff grids while it is in the cache. The
+ * moments equal the ones of Init() up to rounding.
+ * With _clipToUnitBall the voxels outside the unit ball of their placement
+ * count as zero, with the same test as ZernikeDescriptor::NormalizeGrid(), so
+ * the grids need not be cut off before.
+ */
+    static void InitLanes(
+        const InputVoxelIterator * _voxels,    /**< input voxel grids */
+        const Placement * _placements,         /**< center of gravity and scaling factor of every grid */
+        std::size_t _count,     /**< number of the grids */
+        int _xDim,              /**< x-dimension of the input voxel grids */
+        int _yDim,              /**< y-dimension of the input voxel grids */
+        int _zDim,              /**< z-dimension of the input voxel grids */
+        int _maxOrder,          /**< maximal order to compute moments for */
+        ScaledGeometricalMoments * const * _results,   /**< moments of every grid */
+        bool _clipToUnitBall = false    /**< skip the voxels outside the unit ball */
+    )
+    {
+        static_assert(std::is_floating_point<T>::value, "MomentT must be float, double or long double");
+
+        const LaneKernels<T> kernels = LaneKernels<T>::Get();
+        const std::size_t lanes = kernels.lanes_;
+        const int orderCount = _maxOrder + 1;
+
+        // the value of lane l of element e is at [e * lanes + l]
+        T1D slab(static_cast<std::size_t>(_xDim + 1) * _yDim * lanes);     // diff functions along x of a z-slab
+        T1D slabPowers(slab.size());
+        T1D layer(static_cast<std::size_t>(_yDim) * lanes);
+        T1D diffLayer(static_cast<std::size_t>(_yDim + 1) * lanes);
+        T1D arrays(static_cast<std::size_t>(orderCount) * orderCount * _zDim * lanes);  // sums over x and y, [i][j][z][lane]
+        T1D diffArray(static_cast<std::size_t>(_zDim + 1) * lanes);
+        T1D moments(lanes);
+        T1D samples[3];
+
+        const int dims[3] = { _xDim, _yDim, _zDim };
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            samples[axis].resize(static_cast<std::size_t>(dims[axis] + 1) * lanes);
+        }
+
+        auto arraysOf = [&](int _i, int _j)
+        {
+            return arrays.data() + (static_cast<std::size_t>(_i) * orderCount + _j) * _zDim * lanes;
+        };
+
+        for (std::size_t first = 0; first < _count; first += lanes)
+        {
+            const std::size_t groupSize = std::min(lanes, _count - first);
+
+            // the lanes without a grid stay zero
+            std::fill(slab.begin(), slab.end(), static_cast<T>(0));
+
+            for (auto & axisSamples : samples)
+            {
+                std::fill(axisSamples.begin(), axisSamples.end(), static_cast<T>(0));
+            }
+
+            for (std::size_t lane = 0; lane < groupSize; ++lane)
+            {
+                ScaledGeometricalMoments & result = *_results[first + lane];
+                const Placement & placement = _placements[first + lane];
+
+                result.xDim_ = _xDim;
+                result.yDim_ = _yDim;
+                result.zDim_ = _zDim;
+                result.maxOrder_ = _maxOrder;
+                result.moments_.resize(GeometricalMomentCount(_maxOrder));
+                result.ComputeSamples(placement.xCOG_, placement.yCOG_, placement.zCOG_, placement.scale_);
+
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    for (int x = 0; x <= dims[axis]; ++x)
+                    {
+                        samples[axis][x * lanes + lane] = result.samples_[axis][x];
+                    }
+                }
+            }
+
+            for (int z = 0; z < _zDim; ++z)
+            {
+                // the diff functions f(x-1) - f(x) of the lines of the slab, see ComputeDiffFunction()
+                for (std::size_t lane = 0; lane < groupSize; ++lane)
+                {
+                    const Placement & placement = _placements[first + lane];
+
+                    InputVoxelIterator iter{ _voxels[first + lane] };
+                    iter += static_cast<std::ptrdiff_t>(z) * _yDim * _xDim;
+
+                    T * diffIter = slab.data() + lane;
+
+                    const T xCOG = static_cast<T>(placement.xCOG_);
+                    const T radius = static_cast<T>(1) / static_cast<T>(placement.scale_);
+                    const T sqrRadius = radius * radius;
+                    const T dz = static_cast<T>(z) - static_cast<T>(placement.zCOG_);
+
+                    for (int y = 0; y < _yDim; ++y)
+                    {
+                        const T dy = static_cast<T>(y) - static_cast<T>(placement.yCOG_);
+                        T previous(0);
+
+                        for (int x = 0; x <= _xDim; ++x, diffIter += lanes)
+                        {
+                            T current = x < _xDim ? static_cast<T>(iter[x]) : static_cast<T>(0);
+
+                            if (_clipToUnitBall && current != static_cast<T>(0))
+                            {
+                                T dx = static_cast<T>(x) - xCOG;
+
+                                if (dx * dx + dy * dy + dz * dz > sqrRadius)
+                                {
+                                    current = static_cast<T>(0);
+                                }
+                            }
+
+                            *diffIter = previous - current;
+                            previous = current;
+                        }
+
+                        iter += _xDim;
+                    }
+                }
+
+                std::copy(slab.begin(), slab.end(), slabPowers.begin());
+
+                // the stages along x and y of all orders
+                for (int i = 0; i <= _maxOrder; ++i)
+                {
+                    kernels.multiply_(slabPowers.data(), samples[0].data(), _xDim + 1, _yDim, layer.data());
+                    kernels.diff_(layer.data(), diffLayer.data(), _yDim, 1);
+
+                    for (int j = 0; j < orderCount - i; ++j)
+                    {
+                        kernels.multiply_(diffLayer.data(), samples[1].data(), _yDim + 1, 1, arraysOf(i, j) + static_cast<std::size_t>(z) * lanes);
+                    }
+                }
+            }
+
+            // the stage along z
+            for (int i = 0; i <= _maxOrder; ++i)
+            {
+                for (int j = 0; j < orderCount - i; ++j)
+                {
+                    kernels.diff_(arraysOf(i, j), diffArray.data(), _zDim, 1);
+
+                    for (int k = 0; k < orderCount - i - j; ++k)
+                    {
+                        kernels.multiply_(diffArray.data(), samples[2].data(), _zDim + 1, 1, moments.data());
+
+                        for (std::size_t lane = 0; lane < groupSize; ++lane)
+                        {
+                            _results[first + lane]->moments_[GeometricalMomentIndex(i, j, k)] = moments[lane] / ((1 + i) * (1 + j) * (1 + k));
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    /**
+ * Adds _weight times the moments of another grid with the same order, center
+ * of gravity and scaling factor, see GetMoments(). The moments are linear in
+ * the voxel values, so e.g. the moments of removed voxels are subtracted.
+ */
+    void Add(
+        const T1D & _moments,   /**< moments in the order of GeometricalMomentIndex() */
+        T _weight = 1           /**< factor of _moments */
+    )
+    {
+        if (_moments.size() < moments_.size())
+        {
+            throw std::invalid_argument("ScaledGeometricalMoments::Add(): the moments have a lower order.");
+        }
+
+        for (std::size_t index = 0; index < moments_.size(); ++index)
+        {
+            moments_[index] += _weight * _moments[index];
+        }
+    }
+
+    /**
+ * Transforms the moments to another center of gravity and scaling factor.
+ * The scaled coordinates u = (x - cog) * scale become
+ * u' = (x - cog') * scale' = _scaleRatio * (u + _shift) with
+ * _shift = (cog - cog') * scale and _scaleRatio = scale' / scale, so
+ * M'_ijk = _scaleRatio^(i+j+k+3) sum_abc C(i,a) C(j,b) C(k,c) shift^(i-a, j-b, k-c) M_abc.
+ * The sums are taken along one axis after the other. The voxels are the same,
+ * i.e. a cutoff at the unit ball, see ZernikeDescriptor, is not moved.
+ */
+    void Recenter(
+        double _xShift,         /**< (xCOG - xCOG') * scale */
+        double _yShift,         /**< (yCOG - yCOG') * scale */
+        double _zShift,         /**< (zCOG - zCOG') * scale */
+        double _scaleRatio      /**< scale' / scale */
+    )
+    {
+        BinomialTable<double> binomials(maxOrder_);
+
+        const double shifts[3] = { _xShift, _yShift, _zShift };
+
+        Double1D powers(maxOrder_ + 1);
+        Double1D transformed(moments_.size());
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            powers[0] = 1.0;
+
+            for (int p = 1; p <= maxOrder_; ++p)
+            {
+                powers[p] = powers[p - 1] * shifts[axis];
+            }
+
+            for (int i = 0; i <= maxOrder_; ++i)
+            {
+                for (int j = 0; j <= maxOrder_ - i; ++j)
+                {
+                    for (int k = 0; k <= maxOrder_ - i - j; ++k)
+                    {
+                        const int orders[3] = { i, j, k };
+                        const int n = orders[axis];
+
+                        double sum{ 0 };
+
+                        // the terms with a lower order along the axis
+                        for (int a = 0; a <= n; ++a)
+                        {
+                            int lower[3] = { i, j, k };
+                            lower[axis] = a;
+
+                            sum += binomials.Get(n, a) * powers[n - a] * static_cast<double>(moments_[GeometricalMomentIndex(lower[0], lower[1], lower[2])]);
+                        }
+
+                        transformed[GeometricalMomentIndex(i, j, k)] = sum;
+                    }
+                }
+            }
+
+            for (std::size_t index = 0; index < moments_.size(); ++index)
+            {
+                moments_[index] = static_cast<T>(transformed[index]);
+            }
+        }
+
+        for (int order = 0; order <= maxOrder_; ++order)
+        {
+            T factor = static_cast<T>(std::pow(_scaleRatio, order + 3));
+
+            for (std::size_t index = order > 0 ? GeometricalMomentCount(order - 1) : 0; index < GeometricalMomentCount(order); ++index)
+            {
+                moments_[index] *= factor;
+            }
+        }
     }
 
     /// Access function
@@ -135,9 +767,20 @@ public:
         int _i,                 /**< order along x */
         int _j,                 /**< order along y */
         int _k                  /**< order along z */
-    )
+    ) const
     {
-        return moments_[_i][_j][_k];
+        return moments_[GeometricalMomentIndex(_i, _j, _k)];
+    }
+
+    /// All moments, see GeometricalMomentIndex() for the order
+    const T1D & GetMoments() const
+    {
+        return moments_;
+    }
+
+    int GetMaxOrder() const
+    {
+        return maxOrder_;
     }
 
 private:
@@ -146,90 +789,513 @@ private:
         zDim_,
         maxOrder_;          // maximal order of the moments
 
+    // position of the voxel lines of Init() in the input grid, see LineOffset()
+    std::ptrdiff_t  origin_{ 0 },       // first voxel of the box
+                    lineStride_{ 0 },   // distance of the lines along y
+                    slabStride_{ 0 };   // distance of the slabs along z
+
     T2D         samples_;   // samples of the scaled and translated grid in x, y, z
-    T3D         moments_;   // array containing the cumulative moments
+    T1D         moments_;   // array containing the cumulative moments, see GeometricalMomentIndex()
+    T1D         segmentPowers_[3];  // tables of ComputeSegments() between BeginSegments() and EndSegments()
+
+    /// Nonzero entries of the diff functions along x, the entries of line p are [offsets_[p], offsets_[p + 1])
+    struct SparseDiff
+    {
+        vector<std::size_t> offsets_;
+        vector<int>         positions_;     // positions in the line, 0..xDim_
+        T1D                 values_;
+    };
 
     // ---- private functions ----
-    void Compute(InputVoxelIterator voxels)
+    /**
+ * The diff algorithm. With _sparse the x difference grid keeps only its
+ * nonzero entries: for a binary grid these are the transitions between empty
+ * and set voxels along x, so the first stage of every order costs O(surface)
+ * instead of O(dim^3). The sums are the same as in the dense scalar kernel.
+ * With _pool the grid is split into z-slabs, see SlabsPerItem(). The slabs
+ * are independent until the last stage along z, so the moments do not depend
+ * on the number of threads.
+ */
+    void Compute(InputVoxelIterator voxels, bool _sparse, ThreadPool * _pool)
     {
-        static_assert(std::is_floating_point<T>::value, "MomentT must be float, double or long double");
-        int arrayDim = zDim_;
-        int layerDim = yDim_ * zDim_;
+        const int lineCount = yDim_ * zDim_;
+        const int slabsPerItem = SlabsPerItem(zDim_, static_cast<std::size_t>(xDim_) * yDim_);
+        const std::size_t itemCount = (zDim_ + slabsPerItem - 1) / slabsPerItem;
 
-        int diffArrayDim = zDim_ + 1;
-        int diffLayerDim = (yDim_ + 1) * zDim_;
-        int diffGridDim = (xDim_ + 1) * layerDim;
+        // lines [_first, _last) of a work item
+        auto itemLines = [&](std::size_t _item, int & _first, int & _last)
+        {
+            _first = static_cast<int>(_item) * slabsPerItem * yDim_;
+            _last = std::min(_first + slabsPerItem * yDim_, lineCount);
+        };
 
-        T1D diffGrid(diffGridDim);
-        T1D diffLayer(diffLayerDim);
-        T1D diffArray(diffArrayDim);
+        // generate the diff version of the voxel grid in x direction
+        if (_sparse)
+        {
+            vector<SparseDiff> parts(itemCount);
 
-        T1D layer(layerDim);
-        T1D array(arrayDim);
-        T   moment;
+            ParallelFor(_pool, itemCount, [&](std::size_t _item)
+            {
+                int first, last;
+                itemLines(_item, first, last);
 
-        typename T1D::iterator diffIter = diffGrid.begin();
+                ComputeSparseDiff(voxels, first, last, parts[_item]);
+            });
 
-        InputVoxelIterator iter{ voxels };
+            SparseDiff diff;
+            diff.offsets_.push_back(0);
 
-        // generate the diff version of the voxel grid in x direction
-        for (int x = 0; x < layerDim; ++x)
+            for (const SparseDiff & part : parts)
+            {
+                std::size_t base = diff.values_.size();
+
+                for (std::size_t p = 1; p < part.offsets_.size(); ++p)
+                {
+                    diff.offsets_.push_back(base + part.offsets_[p]);
+                }
+
+                diff.positions_.insert(diff.positions_.end(), part.positions_.begin(), part.positions_.end());
+                diff.values_.insert(diff.values_.end(), part.values_.begin(), part.values_.end());
+            }
+
+            ComputeFromDiff(nullptr, &diff, _pool);
+        }
+        else
         {
-            ComputeDiffFunction(iter, diffIter, xDim_);
+            T1D diffGrid(static_cast<std::size_t>(xDim_ + 1) * lineCount);
+
+            ParallelFor(_pool, itemCount, [&](std::size_t _item)
+            {
+                int first, last;
+                itemLines(_item, first, last);
+
+                T * diffIter = diffGrid.data() + static_cast<std::size_t>(first) * (xDim_ + 1);
+
+                for (int p = first; p < last; ++p)
+                {
+                    InputVoxelIterator iter{ voxels };
+                    iter += LineOffset(p);
+
+                    ComputeDiffFunction(iter, diffIter, xDim_);
 
-            iter += xDim_;
-            diffIter += xDim_ + 1;
+                    diffIter += xDim_ + 1;
+                }
+            });
+
+            ComputeFromDiff(diffGrid.data(), nullptr, _pool);
         }
+    }
+
+    /**
+ * The orders of the diff algorithm, either _diffGrid or _sparse is given. The
+ * stages along x and y run per z-slab, the sums of the slabs are kept for all
+ * orders j and contracted along z at the end.
+ */
+    void ComputeFromDiff(T * _diffGrid, SparseDiff * _sparse, ThreadPool * _pool)
+    {
+        static_assert(std::is_floating_point<T>::value, "MomentT must be float, double or long double");
+        const int orderCount = maxOrder_ + 1;
+        const int slabsPerItem = SlabsPerItem(zDim_, static_cast<std::size_t>(xDim_) * yDim_);
+        const std::size_t itemCount = (zDim_ + slabsPerItem - 1) / slabsPerItem;
+
+        T1D diffLayer(static_cast<std::size_t>(yDim_ + 1) * zDim_);
+        T1D diffArray(zDim_ + 1);
+
+        T1D layer(static_cast<std::size_t>(yDim_) * zDim_);
+        T1D arrays(static_cast<std::size_t>(orderCount) * zDim_);     // sums over x and y, [j][z]
+        T   moment;
+
+        // the inner loops, see MomentKernels
+        const MomentKernels<T> kernels = MomentKernels<T>::Get();
 
         for (int i = 0; i <= maxOrder_; ++i)
         {
-            diffIter = diffGrid.begin();
-            for (int p = 0; p < layerDim; ++p)
+            ParallelFor(_pool, itemCount, [&](std::size_t _item)
+            {
+                int zEnd = std::min(static_cast<int>(_item + 1) * slabsPerItem, zDim_);
+
+                for (int z = static_cast<int>(_item) * slabsPerItem; z < zEnd; ++z)
+                {
+                    T * layerIter = layer.data() + static_cast<std::size_t>(z) * yDim_;
+
+                    for (int y = 0; y < yDim_; ++y)
+                    {
+                        std::size_t p = static_cast<std::size_t>(z) * yDim_ + y;
+
+                        if (_sparse != nullptr)
+                        {
+                            // multiply the nonzero entries with the sample values
+                            const T * samples = samples_[0].data();
+                            MomentSum<T> sum;
+
+                            for (std::size_t e = _sparse->offsets_[p]; e < _sparse->offsets_[p + 1]; ++e)
+                            {
+                                _sparse->values_[e] *= samples[_sparse->positions_[e]];
+                                sum.Add(_sparse->values_[e]);
+                            }
+
+                            layerIter[y] = sum.Get();
+                        }
+                        else
+                        {
+                            // multiply the diff function with the sample values
+                            layerIter[y] = kernels.multiply_(_diffGrid + p * (xDim_ + 1), samples_[0].data(), xDim_ + 1);
+                        }
+                    }
+
+                    T * diffIter = diffLayer.data() + static_cast<std::size_t>(z) * (yDim_ + 1);
+                    kernels.diff_(layerIter, diffIter, yDim_);
+
+                    for (int j = 0; j < orderCount - i; ++j)
+                    {
+                        arrays[static_cast<std::size_t>(j) * zDim_ + z] = kernels.multiply_(diffIter, samples_[1].data(), yDim_ + 1);
+                    }
+                }
+            });
+
+            for (int j = 0; j < orderCount - i; ++j)
             {
-                // multiply the diff function with the sample values
-                T1DIter sampleIter(samples_[0].begin());
-                layer[p] = Multiply(diffIter, sampleIter, xDim_ + 1);
+                kernels.diff_(arrays.data() + static_cast<std::size_t>(j) * zDim_, diffArray.data(), zDim_);
 
-                diffIter += xDim_ + 1;
+                for (int k = 0; k < orderCount - i - j; ++k)
+                {
+                    moment = kernels.multiply_(diffArray.data(), samples_[2].data(), zDim_ + 1);
+                    moments_[GeometricalMomentIndex(i, j, k)] = moment / ((1 + i) * (1 + j) * (1 + k));
+                }
             }
+        }
+    }
+
+    /**
+ * The moments as a contraction of the voxels with per-axis tables of the
+ * integrated powers P_i(x) = s(x+1)^(i+1) - s(x)^(i+1):
+ *   M(i,j,k) = sum_z P_k(z) sum_y P_j(y) sum_x P_i(x) f(x,y,z).
+ * The grid is processed slab by slab (fixed z), the partial sums of a slab
+ * fit into the cache, so every voxel is read once for all orders.
+ */
+    void ComputeContraction(InputVoxelIterator _voxels)
+    {
+        static_assert(std::is_floating_point<T>::value, "MomentT must be float, double or long double");
+
+        const int orderCount = maxOrder_ + 1;
 
-            auto layer_iter = layer.begin();
-            diffIter = diffLayer.begin();
-            for (int y = 0; y < arrayDim; ++y)
+        // powers[axis][i * dim + x] = P_i(x)
+        T1D powers[3];
+        ComputeIntegratedPowers(samples_[0], xDim_, powers[0]);
+        ComputeIntegratedPowers(samples_[1], yDim_, powers[1]);
+        ComputeIntegratedPowers(samples_[2], zDim_, powers[2]);
+
+        T1D line(xDim_);
+        T1D slab(yDim_ * orderCount);                   // sums over x, [y][i]
+        T1D slabMoments(orderCount * orderCount);       // sums over x and y, [i][j]
+
+        std::fill(moments_.begin(), moments_.end(), static_cast<T>(0));
+
+        for (int z = 0; z < zDim_; ++z)
+        {
+            bool emptySlab = true;
+
+            for (int y = 0; y < yDim_; ++y)
             {
-                ComputeDiffFunction(layer_iter, diffIter, yDim_);
+                bool emptyLine = true;
+
+                InputVoxelIterator iter{ _voxels };
+                iter += LineOffset(z * yDim_ + y);
 
-                layer_iter += yDim_;
-                diffIter += yDim_ + 1;
+                for (int x = 0; x < xDim_; ++x)
+                {
+                    line[x] = static_cast<T>(iter[x]);
+                    emptyLine = emptyLine && line[x] == static_cast<T>(0);
+                }
+
+                T * slabIter = slab.data() + y * orderCount;
+
+                if (emptyLine)
+                {
+                    std::fill(slabIter, slabIter + orderCount, static_cast<T>(0));
+                    continue;
+                }
+
+                emptySlab = false;
+
+                for (int i = 0; i < orderCount; ++i)
+                {
+                    const T * power = powers[0].data() + i * xDim_;
+                    MomentSum<T> sum;
+
+                    for (int x = 0; x < xDim_; ++x)
+                    {
+                        sum.Add(power[x] * line[x]);
+                    }
+
+                    slabIter[i] = sum.Get();
+                }
             }
 
-            for (int j = 0; j < maxOrder_ + 1 - i; ++j)
+            if (emptySlab)
             {
-                diffIter = diffLayer.begin();
-                for (int p = 0; p < arrayDim; ++p)
+                continue;
+            }
+
+            for (int i = 0; i < orderCount; ++i)
+            {
+                for (int j = 0; j < orderCount - i; ++j)
                 {
-                    T1DIter sampleIter(samples_[1].begin());
-                    array[p] = Multiply(diffIter, sampleIter, yDim_ + 1);
+                    const T * power = powers[1].data() + j * yDim_;
+                    MomentSum<T> sum;
+
+                    for (int y = 0; y < yDim_; ++y)
+                    {
+                        sum.Add(power[y] * slab[y * orderCount + i]);
+                    }
 
-                    diffIter += yDim_ + 1;
+                    slabMoments[i * orderCount + j] = sum.Get();
                 }
+            }
+
+            for (int i = 0; i < orderCount; ++i)
+            {
+                for (int j = 0; j < orderCount - i; ++j)
+                {
+                    const T slabMoment = slabMoments[i * orderCount + j];
 
-                auto mom_iter = array.begin();
-                diffIter = diffArray.begin();
-                ComputeDiffFunction(mom_iter, diffIter, zDim_);
+                    for (int k = 0; k < orderCount - i - j; ++k)
+                    {
+                        moments_[GeometricalMomentIndex(i, j, k)] += powers[2][k * zDim_ + z] * slabMoment;
+                    }
+                }
+            }
+        }
 
-                for (int k = 0; k < maxOrder_ + 1 - i - j; ++k)
+        for (int i = 0; i < orderCount; ++i)
+        {
+            for (int j = 0; j < orderCount - i; ++j)
+            {
+                for (int k = 0; k < orderCount - i - j; ++k)
                 {
-                    T1DIter sampleIter(samples_[2].begin());
+                    moments_[GeometricalMomentIndex(i, j, k)] /= static_cast<T>((1 + i) * (1 + j) * (1 + k));
+                }
+            }
+        }
+    }
 
-                    moment = Multiply(diffIter, sampleIter, zDim_ + 1);
-                    moments_[i][j][k] = moment / ((1 + i) * (1 + j) * (1 + k));
+    /**
+ * The tables of ComputeSegments(): the integrated powers along x and z, see
+ * ComputeIntegratedPowers(), and segmentPowers_[1][j * (yDim_ + 1) + y] = s(y)^(j+1).
+ */
+    void ComputeSegmentPowers()
+    {
+        const int orderCount = maxOrder_ + 1;
+
+        ComputeIntegratedPowers(samples_[0], xDim_, segmentPowers_[0]);
+        ComputeIntegratedPowers(samples_[2], zDim_, segmentPowers_[2]);
+
+        T1D & yPowers = segmentPowers_[1];
+        yPowers.resize(orderCount * (yDim_ + 1));
+
+        for (int y = 0; y <= yDim_; ++y)
+        {
+            T power = samples_[1][y];
+
+            for (int j = 0; j < orderCount; ++j)
+            {
+                yPowers[j * (yDim_ + 1) + y] = power;
+                power *= samples_[1][y];
+            }
+        }
+    }
+
+    /**
+ * Adds the moments of the segments [y0, y1) of lines (x, z) without the
+ * factors 1/((1+i)(1+j)(1+k)). The sum over y of the integrated powers
+ * telescopes: sum_y P_j(y) = s(y1)^(j+1) - s(y0)^(j+1), so a segment costs
+ * O(maxOrder_). The sums of a line and of a plane x are contracted with P_k(z)
+ * and P_i(x) when the line or the plane changes.
+ */
+    void ComputeSegments(const VoxelSegments & _segments)
+    {
+        static_assert(std::is_floating_point<T>::value, "MomentT must be float, double or long double");
+
+        const int orderCount = maxOrder_ + 1;
+
+        const T1D & xPowers = segmentPowers_[0];
+        const T1D & yPowers = segmentPowers_[1];
+        const T1D & zPowers = segmentPowers_[2];
+
+        T1D line(orderCount);                       // sums over the segments of a line, [j]
+        T1D plane(orderCount * orderCount);         // sums over the lines of a plane x, [j][k]
+
+        auto flushLine = [&](int _z)
+        {
+            for (int j = 0; j < orderCount; ++j)
+            {
+                for (int k = 0; k < orderCount - j; ++k)
+                {
+                    plane[j * orderCount + k] += zPowers[k * zDim_ + _z] * line[j];
+                }
+            }
+
+            std::fill(line.begin(), line.end(), static_cast<T>(0));
+        };
+
+        auto flushPlane = [&](int _x)
+        {
+            for (int i = 0; i < orderCount; ++i)
+            {
+                for (int j = 0; j < orderCount - i; ++j)
+                {
+                    for (int k = 0; k < orderCount - i - j; ++k)
+                    {
+                        moments_[GeometricalMomentIndex(i, j, k)] += xPowers[i * xDim_ + _x] * plane[j * orderCount + k];
+                    }
+                }
+            }
+
+            std::fill(plane.begin(), plane.end(), static_cast<T>(0));
+        };
+
+        const auto & segments = _segments.GetSegments();
+
+        for (std::size_t s = 0; s < segments.size(); ++s)
+        {
+            const VoxelSegments::Segment & segment = segments[s];
+
+            for (int j = 0; j < orderCount; ++j)
+            {
+                line[j] += yPowers[j * (yDim_ + 1) + segment.yEnd_] - yPowers[j * (yDim_ + 1) + segment.yBegin_];
+            }
+
+            bool lastOfLine = s + 1 == segments.size() || segments[s + 1].x_ != segment.x_ || segments[s + 1].z_ != segment.z_;
+            bool lastOfPlane = s + 1 == segments.size() || segments[s + 1].x_ != segment.x_;
+
+            if (lastOfLine)
+            {
+                flushLine(segment.z_);
+            }
+
+            if (lastOfPlane)
+            {
+                flushPlane(segment.x_);
+            }
+        }
+    }
+
+    /**
+ * Adds the moments of the full bricks of the slab _bx without the factors
+ * 1/((1+i)(1+j)(1+k)), between BeginSegments() and EndSegments(), and appends
+ * its mixed bricks to _mixed, ordered by z and y. The sums along y of the full
+ * bricks of a row (bx, bz) are added, contracted with the sums along z of the
+ * row and, once per slab, with the sums along x. So a full brick costs
+ * O(maxOrder_), a row O(maxOrder_^2) and a slab O(maxOrder_^3).
+ */
+    void AddFullBricks(const BrickVoxelGrid & _grid, int _bx, vector<std::size_t> & _mixed)
+    {
+        const int brickDim = BrickVoxelGrid::brickDim;
+        const int bricksPerEdge = _grid.GetBricksPerEdge();
+        const int orderCount = maxOrder_ + 1;
+
+        const T1D & xPowers = segmentPowers_[0];
+        const T1D & yPowers = segmentPowers_[1];
+        const T1D & zPowers = segmentPowers_[2];
+
+        T1D row(orderCount);                        // sums along y of the full bricks of a row, [j]
+        T1D slab(orderCount * orderCount, static_cast<T>(0));    // sums of the rows of the slab, [j][k]
+        bool slabFull = false;
+
+        for (int bz = 0; bz < bricksPerEdge; ++bz)
+        {
+            bool rowFull = false;
+
+            std::fill(row.begin(), row.end(), static_cast<T>(0));
+
+            for (int by = 0; by < bricksPerEdge; ++by)
+            {
+                std::size_t brick = _grid.GetBrickIndex(_bx, by, bz);
+
+                if (_grid.IsFull(brick))
+                {
+                    const int yBegin = by * brickDim, yEnd = std::min(yBegin + brickDim, yDim_);
+
+                    for (int j = 0; j < orderCount; ++j)
+                    {
+                        row[j] += yPowers[j * (yDim_ + 1) + yEnd] - yPowers[j * (yDim_ + 1) + yBegin];
+                    }
+
+                    rowFull = true;
+                }
+                else if (!_grid.IsEmpty(brick))
+                {
+                    _mixed.push_back(brick);
+                }
+            }
+
+            if (rowFull)
+            {
+                for (int k = 0; k < orderCount; ++k)
+                {
+                    T zSum = static_cast<T>(0);
+
+                    for (int z = bz * brickDim; z < std::min((bz + 1) * brickDim, zDim_); ++z)
+                    {
+                        zSum += zPowers[k * zDim_ + z];
+                    }
+
+                    for (int j = 0; j < orderCount - k; ++j)
+                    {
+                        slab[j * orderCount + k] += row[j] * zSum;
+                    }
+                }
+
+                slabFull = true;
+            }
+        }
+
+        if (!slabFull)
+        {
+            return;
+        }
+
+        for (int i = 0; i < orderCount; ++i)
+        {
+            T xSum = static_cast<T>(0);
+
+            for (int x = _bx * brickDim; x < std::min((_bx + 1) * brickDim, xDim_); ++x)
+            {
+                xSum += xPowers[i * xDim_ + x];
+            }
+
+            for (int j = 0; j < orderCount - i; ++j)
+            {
+                for (int k = 0; k < orderCount - i - j; ++k)
+                {
+                    moments_[GeometricalMomentIndex(i, j, k)] += xSum * slab[j * orderCount + k];
                 }
             }
         }
     }
 
-    void ComputeSamples(double _xCOG, double _yCOG, double _zCOG, double _scale)
+    /// _powers[i * _dim + x] = _samples[x + 1]^(i + 1) - _samples[x]^(i + 1), i <= maxOrder_
+    void ComputeIntegratedPowers(const T1D & _samples, int _dim, T1D & _powers) const
+    {
+        T1D samplePowers(_samples);
+
+        _powers.resize((maxOrder_ + 1) * _dim);
+
+        for (int i = 0; i <= maxOrder_; ++i)
+        {
+            for (int x = 0; x < _dim; ++x)
+            {
+                _powers[i * _dim + x] = samplePowers[x + 1] - samplePowers[x];
+            }
+
+            for (int x = 0; x <= _dim; ++x)
+            {
+                samplePowers[x] *= _samples[x];
+            }
+        }
+    }
+
+    void ComputeSamples(double _xCOG, double _yCOG, double _zCOG, double _scale, int _xOrigin = 0, int _yOrigin = 0, int _zOrigin = 0)
     {
         samples_.resize(3);    // 3 dimensions
 
@@ -238,6 +1304,12 @@ private:
         dim[1] = yDim_;
         dim[2] = zDim_;
 
+        // first voxel of a box, the samples are the ones of the whole grid
+        int origin[3];
+        origin[0] = _xOrigin;
+        origin[1] = _yOrigin;
+        origin[2] = _zOrigin;
+
         double min[3];
         min[0] = (-_xCOG) * _scale;
         min[1] = (-_yCOG) * _scale;
@@ -248,41 +1320,57 @@ private:
             samples_[i].resize(dim[i] + 1);
             for (int j = 0; j <= dim[i]; ++j)
             {
-                samples_[i][j] = min[i] + j * _scale;
+                samples_[i][j] = min[i] + (j + origin[i]) * _scale;
             }
         }
     }
 
-    template<typename T_ = InputVoxelIterator>
-    void ComputeDiffFunction(InputVoxelIterator _iter, T1DIter _diffIter, int _dim, std::enable_if_t<!std::is_same<T_, T1DIter>::value> * = nullptr)
+    /// Offset of the line _p of Init() in the input grid, the lines along x are ordered by z and y
+    std::ptrdiff_t LineOffset(int _p) const
     {
-        _diffIter[0] = -_iter[0];
-        for (int i = 1; i < _dim; ++i)
-        {
-            _diffIter[i] = static_cast<MomentT>(_iter[i - 1]) - static_cast<MomentT>(_iter[i]);
-        }
-        _diffIter[_dim] = _iter[_dim - 1];
+        return origin_ + (_p / yDim_) * slabStride_ + (_p % yDim_) * lineStride_;
     }
 
-    void ComputeDiffFunction(T1DIter _iter, T1DIter _diffIter, int _dim)
+    /**
+ * The nonzero entries of the diff functions of the lines [_first, _last) along x:
+ * the position in the line, 0..xDim_, and the value f(x-1) - f(x).
+ */
+    void ComputeSparseDiff(InputVoxelIterator _voxels, int _first, int _last, SparseDiff & _diff) const
     {
-        _diffIter[0] = -_iter[0];
-        for (int i = 1; i < _dim; ++i)
+        _diff.offsets_.resize(_last - _first + 1);
+        _diff.offsets_[0] = 0;
+
+        for (int p = 0; p < _last - _first; ++p)
         {
-            _diffIter[i] = _iter[i - 1] - _iter[i];
+            InputVoxelIterator iter{ _voxels };
+            iter += LineOffset(_first + p);
+
+            T previous(0);
+
+            for (int x = 0; x <= xDim_; ++x)
+            {
+                T current = x < xDim_ ? static_cast<T>(iter[x]) : static_cast<T>(0);
+
+                if (current != previous)
+                {
+                    _diff.positions_.push_back(x);
+                    _diff.values_.push_back(previous - current);
+                }
+
+                previous = current;
+            }
+
+            _diff.offsets_[p + 1] = _diff.values_.size();
         }
-        _diffIter[_dim] = _iter[_dim - 1];
     }
 
-    T Multiply(T1DIter _diffIter, T1DIter _sampleIter, int _dim)
+    void ComputeDiffFunction(InputVoxelIterator _iter, T * _diffIter, int _dim)
     {
-        T sum(0);
-        for (int i = 0; i < _dim; ++i)
+        _diffIter[0] = -_iter[0];
+        for (int i = 1; i < _dim; ++i)
         {
-            _diffIter[i] *= _sampleIter[i];
-            sum += _diffIter[i];
+            _diffIter[i] = static_cast<MomentT>(_iter[i - 1]) - static_cast<MomentT>(_iter[i]);
         }
-
-        return sum;
+        _diffIter[_dim] = _iter[_dim - 1];
     }
 };
\ No newline at end of file
@@ -0,0 +1,227 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of threads shared by several users, e.g. the worker threads of
+ * the application which split a large grid into slabs. The calling thread
+ * takes part in ParallelFor(), so a pool without threads runs everything on
+ * the caller and a busy pool never blocks it.
+ */
+class ThreadPool
+{
+public:
+    // ---- public member functions ----
+    explicit ThreadPool(unsigned _threadCount) :
+        stop_(false)
+    {
+        for (unsigned i = 0; i < _threadCount; ++i)
+        {
+            threads_.emplace_back([this]() { Run(); });
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool & operator=(const ThreadPool &) = delete;
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+
+        condition_.notify_all();
+
+        for (auto & thread : threads_)
+        {
+            thread.join();
+        }
+    }
+
+    /// Number of the threads of the pool without the callers
+    unsigned GetThreadCount() const
+    {
+        return static_cast<unsigned>(threads_.size());
+    }
+
+    /**
+ * Calls _function(i) for i = 0.._count-1 on the calling thread and the free
+ * threads of the pool. The items are handed out one by one in ascending order.
+ * The first exception thrown by _function is rethrown.
+ */
+    template<class Function>
+    void ParallelFor(std::size_t _count, Function && _function)
+    {
+        if (_count == 0)
+        {
+            return;
+        }
+
+        struct State
+        {
+            std::atomic<std::size_t>    next_{ 0 };
+            std::mutex                  mutex_;
+            std::condition_variable     done_;
+            unsigned                    active_{ 0 };       // helpers which run items
+            bool                        closed_{ false };   // no new helpers after the caller has finished
+            std::exception_ptr          error_;
+        };
+
+        auto state = std::make_shared<State>();
+
+        auto work = [state, _count, &_function]()
+        {
+            try
+            {
+                for (std::size_t item = state->next_++; item < _count; item = state->next_++)
+                {
+                    _function(item);
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(state->mutex_);
+
+                if (!state->error_)
+                {
+                    state->error_ = std::current_exception();
+                }
+
+                state->next_ = _count;
+            }
+        };
+
+        std::size_t helperCount = std::min<std::size_t>(threads_.size(), _count - 1);
+
+        for (std::size_t i = 0; i < helperCount; ++i)
+        {
+            // a helper which starts after the caller has finished does nothing, _function may be gone then
+            Post([state, work]()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex_);
+
+                    if (state->closed_)
+                    {
+                        return;
+                    }
+
+                    ++state->active_;
+                }
+
+                work();
+
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex_);
+                    --state->active_;
+                }
+
+                state->done_.notify_all();
+            });
+        }
+
+        work();
+
+        std::unique_lock<std::mutex> lock(state->mutex_);
+        state->closed_ = true;
+        state->done_.wait(lock, [&state]() { return state->active_ == 0; });
+
+        if (state->error_)
+        {
+            std::rethrow_exception(state->error_);
+        }
+    }
+
+private:
+    // ---- private member functions ----
+    void Post(std::function<void()> _task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push_back(std::move(_task));
+        }
+
+        condition_.notify_one();
+    }
+
+    void Run()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                condition_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+
+                if (tasks_.empty())
+                {
+                    return;
+                }
+
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+
+            task();
+        }
+    }
+
+    // ---- private attributes -----
+    std::vector<std::thread>            threads_;
+    std::deque<std::function<void()> >  tasks_;
+    std::mutex                          mutex_;
+    std::condition_variable             condition_;
+    bool                                stop_;
+};
+
+/// ThreadPool::ParallelFor() on _pool or a plain loop if there is no pool
+template<class Function>
+void ParallelFor(ThreadPool * _pool, std::size_t _count, Function && _function)
+{
+    if (_pool != nullptr)
+    {
+        _pool->ParallelFor(_count, _function);
+        return;
+    }
+
+    for (std::size_t item = 0; item < _count; ++item)
+    {
+        _function(item);
+    }
+}
+
+/**
+ * Number of the z-slabs of a work item when _slabCount slabs of _slabSize
+ * voxels are split over threads. It depends on the grid only, so the results
+ * do not depend on the number of threads. The items start at multiples of 64
+ * voxels, so two items never write the same word of a std::vector<bool>.
+ */
+inline int SlabsPerItem(int _slabCount, std::size_t _slabSize)
+{
+    std::size_t alignment = 64;
+
+    while (alignment > 1 && _slabSize % 2 == 0)
+    {
+        alignment /= 2;
+        _slabSize /= 2;
+    }
+
+    std::size_t slabs = std::max(1, _slabCount / 64);
+
+    return static_cast<int>((slabs + alignment - 1) / alignment * alignment);
+}
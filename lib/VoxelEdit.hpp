@@ -0,0 +1,116 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#pragma once
+
+#include <stdexcept>
+
+#include "VoxelSegments.hpp"
+
+/**
+ * Changes of a binary cubic voxel grid: the voxels which are set and the ones
+ * which are cleared, both as segments along y, see VoxelSegments. The voxel
+ * (x, y, z) is the one of the dense grids with the index (z * dim + y) * dim + x.
+ * The moments of the edited grid are the moments of the original grid plus the
+ * moments of the set voxels minus the ones of the cleared voxels, see the
+ * according constructor of ZernikeDescriptor.
+ * A voxel must really change its value, i.e. a set voxel was empty before, and
+ * it must be changed once only.
+ */
+class VoxelEdit
+{
+public:
+    // ---- public member functions ----
+    explicit VoxelEdit(int _dim = 0) :
+        set_(_dim), cleared_(_dim)
+    {
+    }
+
+    /// The voxel was empty and is set
+    void Set(int _x, int _y, int _z)
+    {
+        set_.Add(_x, _z, _y, _y + 1);
+    }
+
+    /// The voxel was set and is cleared
+    void Clear(int _x, int _y, int _z)
+    {
+        cleared_.Add(_x, _z, _y, _y + 1);
+    }
+
+    /**
+ * Adds the changes of a box of the grid: _oldVoxels and _newVoxels are its
+ * values before and after the change in the order of the dense grids, i.e.
+ * x is the fastest. Voxels which keep their value are skipped.
+ */
+    template<class InputVoxelIterator>
+    void AddRegion(
+        int _x, int _y, int _z,                 /**< first voxel of the box */
+        int _xSize, int _ySize, int _zSize,     /**< size of the box */
+        InputVoxelIterator _oldVoxels,          /**< values before the change */
+        InputVoxelIterator _newVoxels           /**< values after the change */
+    )
+    {
+        int dim = set_.GetDim();
+
+        if (_x < 0 || _y < 0 || _z < 0 || _xSize < 0 || _ySize < 0 || _zSize < 0 ||
+            _x + _xSize > dim || _y + _ySize > dim || _z + _zSize > dim)
+        {
+            throw std::out_of_range("VoxelEdit::AddRegion(): the box is out of the grid.");
+        }
+
+        // runs of set and cleared voxels along y, ordered by x and z as VoxelSegments prefers
+        for (int x = 0; x < _xSize; ++x)
+        {
+            for (int z = 0; z < _zSize; ++z)
+            {
+                int runBegin = 0, runValue = 0;
+
+                for (int y = 0; y <= _ySize; ++y)
+                {
+                    int value{ 0 };
+
+                    if (y < _ySize)
+                    {
+                        auto index = (static_cast<std::size_t>(z) * _ySize + y) * _xSize + x;
+
+                        value = static_cast<int>(_newVoxels[index] != 0) - static_cast<int>(_oldVoxels[index] != 0);
+                    }
+
+                    if (value != runValue)
+                    {
+                        if (runValue != 0)
+                        {
+                            (runValue > 0 ? set_ : cleared_).Add(_x + x, _z + z, _y + runBegin, _y + y);
+                        }
+
+                        runBegin = y;
+                        runValue = value;
+                    }
+                }
+            }
+        }
+    }
+
+    int GetDim() const
+    {
+        return set_.GetDim();
+    }
+
+    /// The voxels which are set by the edit
+    const VoxelSegments & GetSet() const
+    {
+        return set_;
+    }
+
+    /// The voxels which are cleared by the edit
+    const VoxelSegments & GetCleared() const
+    {
+        return cleared_;
+    }
+
+private:
+    // ---- private attributes -----
+    VoxelSegments   set_;
+    VoxelSegments   cleared_;
+};
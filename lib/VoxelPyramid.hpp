@@ -0,0 +1,166 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * Resolution pyramid of a voxel grid in the order of the dense grids, i.e. the
+ * voxel (x, y, z) has the index (z * yDim + y) * xDim + x. The level l is the
+ * grid box-filtered by 2^l along every axis: a voxel is the fraction of the set
+ * voxels of its block of 2^l x 2^l x 2^l voxels, the voxels beyond the edges of
+ * the grid count as empty. Every level is the average of blocks of 2^3 voxels of
+ * the previous one, which is exact for a float grid up to the level 7.
+ * The levels are fractional grids for the dense constructors of
+ * ZernikeDescriptor with _occupancy set. The descriptor does not depend on the size of the object,
+ * so the descriptor of the level l approximates the one of the original grid at
+ * 1/8^l of the voxels, see tools/downsample_report.cpp for the deviation.
+ */
+template<class T = float>
+class VoxelPyramid
+{
+public:
+    typedef std::vector<T>  T1D;
+
+    // ---- public member functions ----
+    template<class InputVoxelIterator>
+    VoxelPyramid(
+        InputVoxelIterator _voxels,     /**< the original grid, level 0 */
+        int _xDim,                      /**< x-dimension of the grid */
+        int _yDim,                      /**< y-dimension of the grid */
+        int _zDim,                      /**< z-dimension of the grid */
+        int _levelCount                 /**< levels 1 to _levelCount are computed */
+    )
+    {
+        if (_xDim < 0 || _yDim < 0 || _zDim < 0 || _levelCount < 0)
+        {
+            throw std::invalid_argument("VoxelPyramid: the dimensions and the level count must be non-negative.");
+        }
+
+        levels_.resize(_levelCount);
+
+        for (int level = 1; level <= _levelCount; ++level)
+        {
+            if (level == 1)
+            {
+                Halve(_voxels, _xDim, _yDim, _zDim, levels_[0]);
+            }
+            else
+            {
+                const Level & finer = levels_[level - 2];
+
+                Halve(finer.voxels_.begin(), finer.xDim_, finer.yDim_, finer.zDim_, levels_[level - 1]);
+            }
+        }
+    }
+
+    int GetLevelCount() const
+    {
+        return static_cast<int>(levels_.size());
+    }
+
+    /// Edge of the blocks of the original voxels which form a voxel of the level
+    static int GetFactor(int _level)
+    {
+        return 1 << _level;
+    }
+
+    /// The voxels of the level 1 to GetLevelCount(), the descriptor clears the ones outside of the unit ball
+    T1D & GetVoxels(int _level)
+    {
+        return GetLevel(_level).voxels_;
+    }
+
+    const T1D & GetVoxels(int _level) const
+    {
+        return GetLevel(_level).voxels_;
+    }
+
+    void GetDims(int _level, int & _xDim, int & _yDim, int & _zDim) const
+    {
+        const Level & level = GetLevel(_level);
+
+        _xDim = level.xDim_;
+        _yDim = level.yDim_;
+        _zDim = level.zDim_;
+    }
+
+private:
+    struct Level
+    {
+        T1D     voxels_;
+        int     xDim_, yDim_, zDim_;
+    };
+
+    // ---- private member functions ----
+    Level & GetLevel(int _level)
+    {
+        return const_cast<Level &>(static_cast<const VoxelPyramid *>(this)->GetLevel(_level));
+    }
+
+    const Level & GetLevel(int _level) const
+    {
+        if (_level < 1 || _level > GetLevelCount())
+        {
+            throw std::out_of_range("VoxelPyramid: the level is out of the pyramid.");
+        }
+
+        return levels_[_level - 1];
+    }
+
+    /// _coarse is _voxels box-filtered by 2 along every axis, an odd edge gets a half-empty last voxel
+    template<class InputVoxelIterator>
+    static void Halve(InputVoxelIterator _voxels, int _xDim, int _yDim, int _zDim, Level & _coarse)
+    {
+        _coarse.xDim_ = (_xDim + 1) / 2;
+        _coarse.yDim_ = (_yDim + 1) / 2;
+        _coarse.zDim_ = (_zDim + 1) / 2;
+
+        _coarse.voxels_.resize(static_cast<std::size_t>(_coarse.xDim_) * _coarse.yDim_ * _coarse.zDim_);
+
+        for (int cz = 0; cz < _coarse.zDim_; ++cz)
+        {
+            for (int cy = 0; cy < _coarse.yDim_; ++cy)
+            {
+                // the up to 4 lines of the blocks are read sequentially, e.g. a std::vector<bool> is not indexed per voxel
+                InputVoxelIterator lines[4] = { _voxels, _voxels, _voxels, _voxels };
+                int lineCount = 0;
+
+                for (int z = 2 * cz; z < std::min(2 * cz + 2, _zDim); ++z)
+                {
+                    for (int y = 2 * cy; y < std::min(2 * cy + 2, _yDim); ++y)
+                    {
+                        lines[lineCount++] += (static_cast<std::size_t>(z) * _yDim + y) * _xDim;
+                    }
+                }
+
+                T * coarseLine = _coarse.voxels_.data() + (static_cast<std::size_t>(cz) * _coarse.yDim_ + cy) * _coarse.xDim_;
+
+                for (int cx = 0; cx < _coarse.xDim_; ++cx)
+                {
+                    const bool isPair = 2 * cx + 1 < _xDim;
+                    T sum = static_cast<T>(0);
+
+                    for (int l = 0; l < lineCount; ++l)
+                    {
+                        sum += static_cast<T>(*lines[l]++);
+
+                        if (isPair)
+                        {
+                            sum += static_cast<T>(*lines[l]++);
+                        }
+                    }
+
+                    coarseLine[cx] = sum * static_cast<T>(0.125);
+                }
+            }
+        }
+    }
+
+    // ---- private attributes -----
+    std::vector<Level>  levels_;        // levels_[l - 1] is the level l
+};
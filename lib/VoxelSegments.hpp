@@ -0,0 +1,102 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * Binary cubic voxel grid stored as segments of lines parallel to the y axis:
+ * the voxels (x, y, z) with y in [yBegin_, yEnd_) are set. It is the natural
+ * form of run-length encoded binvox data, whose runs go along y. The moments
+ * of such a grid cost O(number of segments) instead of O(dim^3), see
+ * ScaledGeometricalMoments::InitFromSegments().
+ * The segments are usually ordered by x, then z, then y, e.g. in binvox
+ * order. Other orders give the same moments but are slower.
+ */
+class VoxelSegments
+{
+public:
+    struct Segment
+    {
+        int x_, z_;
+        int yBegin_, yEnd_;
+    };
+
+    // ---- public member functions ----
+    explicit VoxelSegments(int _dim = 0) :
+        dim_(_dim), voxelCount_(0)
+    {
+    }
+
+    /// Removes all segments and sets the dimension of the grid
+    void Reset(int _dim)
+    {
+        dim_ = _dim;
+        voxelCount_ = 0;
+        segments_.clear();
+    }
+
+    /**
+ * Adds the voxels (_x, y, _z), y in [_yBegin, _yEnd). A segment which continues
+ * the last one on the same line is merged with it.
+ */
+    void Add(int _x, int _z, int _yBegin, int _yEnd)
+    {
+        if (_x < 0 || _x >= dim_ || _z < 0 || _z >= dim_ || _yBegin < 0 || _yBegin > _yEnd || _yEnd > dim_)
+        {
+            throw std::out_of_range("VoxelSegments::Add(): the segment is out of the grid.");
+        }
+
+        if (_yBegin == _yEnd)
+        {
+            return;
+        }
+
+        voxelCount_ += _yEnd - _yBegin;
+
+        if (!segments_.empty())
+        {
+            Segment & last = segments_.back();
+
+            if (last.x_ == _x && last.z_ == _z && last.yEnd_ == _yBegin)
+            {
+                last.yEnd_ = _yEnd;
+                return;
+            }
+        }
+
+        segments_.push_back(Segment{ _x, _z, _yBegin, _yEnd });
+    }
+
+    int GetDim() const
+    {
+        return dim_;
+    }
+
+    /// Number of the set voxels
+    std::size_t GetVoxelCount() const
+    {
+        return voxelCount_;
+    }
+
+    const std::vector<Segment> & GetSegments() const
+    {
+        return segments_;
+    }
+
+private:
+    // ---- private attributes -----
+    std::vector<Segment>    segments_;
+    int                     dim_;           // length of the edge of the grid
+    std::size_t             voxelCount_;    // number of the set voxels
+};
+
+/**
+ * Gives a binary grid in parts, usually plane by plane: a reader calls the
+ * visitor for every part. The parts do not overlap and have the same dimension.
+ */
+typedef std::function<void(const std::function<void(const VoxelSegments &)> &)> VoxelSegmentsReader;
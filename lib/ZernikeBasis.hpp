@@ -0,0 +1,900 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+/*
+
+                          3D Zernike Moments
+    Copyright (C) 2003 by Computer Graphics Group, University of Bonn
+           http://www.cg.cs.uni-bonn.de/project-pages/3dsearch/
+
+Code by Marcin Novotni:     marcin@cs.uni-bonn.de
+
+for more information, see the paper:
+
+@inproceedings{novotni-2003-3d,
+    author = {M. Novotni and R. Klein},
+    title = {3{D} {Z}ernike Descriptors for Content Based Shape Retrieval},
+    booktitle = {The 8th ACM Symposium on Solid Modeling and Applications},
+    pages = {216--225},
+    year = {2003},
+    month = {June},
+    institution = {Universit\"{a}t Bonn},
+    conference = {The 8th ACM Symposium on Solid Modeling and Applications, June 16-20, Seattle, WA}
+}
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *                                License                                    *
+ *                                                                           *
+ *  This library is free software; you can redistribute it and/or modify it  *
+ *  under the terms of the GNU Library General Public License as published   *
+ *  by the Free Software Foundation, version 2.                              *
+ *                                                                           *
+ *  This library is distributed in the hope that it will be useful, but      *
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU        *
+ *  Library General Public License for more details.                         *
+ *                                                                           *
+ *  You should have received a copy of the GNU Library General Public        *
+ *  License along with this library; if not, write to the Free Software      *
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.                *
+ *                                                                           *
+\*===========================================================================*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+// ----- local program includes -----
+#include "BinomialTable.hpp"
+#include "ScaledGeometricMoments.hpp"
+
+using std::vector;
+
+/**
+ * Immutable set of all input data independent coefficients of the Zernike
+ * moments up to a given order: the normalizing factors of the harmonic and
+ * radial polynomials and the coefficients of the geometrical moments.
+ * Since the basis does not depend on the object it is built once per
+ * (order, MomentT) and shared read-only between threads, see Get().
+ * Every coefficient is w * i^p, i.e. it is either purely real or purely
+ * imaginary. They are kept in two real sparse tables (see Table), one for
+ * the real and one for the imaginary coefficients. The arrays are either
+ * owned or live in a read-only mapped basis file, see Load().
+ */
+template<class MomentT>
+class ZernikeBasis
+{
+public:
+    // ---- public typedefs ----
+    typedef MomentT             T;
+    typedef vector<T>           T1D;        // vector of scalar type
+    typedef vector<T1D>         T2D;        // 2D array of scalar type
+    typedef vector<T2D>         T3D;        // 3D array of scalar type
+
+    typedef std::complex<T>                      ComplexT;       // complex type
+
+    /**
+     * Type of the binomials and the q and c coefficients while the basis is
+     * computed. It is at least double, so a float basis differs from a double
+     * basis only by the rounding of the stored values.
+     */
+    typedef typename std::conditional<(sizeof(T) < sizeof(double)), double, T>::type CoefficientT;
+
+    /**
+     * Sparse table of real coefficients in CSR layout: one row per Zernike
+     * moment [n,l,m] (see GetRowIndex()), the column is the index of the
+     * geometrical moment in the flat moment array (see GeometricalMomentIndex()).
+     */
+    struct Table
+    {
+        const std::uint64_t *   rowOffsets_;    // GetRowCount() + 1 offsets into columns_ and values_
+        const std::uint32_t *   columns_;
+        const T *               values_;
+    };
+
+    /// Version of the basis file layout, see Save()
+    static constexpr std::uint32_t fileVersion = 3;
+
+public:
+    // ---- public member functions ----
+    /**
+ * Computes the basis of the given order on _threadCount threads, 0 means one
+ * thread per hardware thread. The result does not depend on the number of
+ * threads, every coefficient is computed by the same code in the same order.
+ */
+    explicit ZernikeBasis(int _order, unsigned _threadCount = 0) :
+        tables_{}, binomials_(2 * std::max(_order, 0) + 1), order_(_order), threadCount_(_threadCount)
+    {
+        static_assert(std::is_floating_point<T>::value, "MomentT must be float, double or long double");
+
+        if (order_ < 0)
+        {
+            throw std::invalid_argument("ZernikeBasis<MomentT>::ZernikeBasis(): order must be non-negative.");
+        }
+
+        if (threadCount_ == 0)
+        {
+            threadCount_ = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        ComputeCs();
+        ComputeQs();
+        ComputeRowIndices();
+        ComputeGCoefficients();
+
+        for (int t = 0; t < tableCount; ++t)
+        {
+            tables_[t].rowOffsets_ = ownedTables_[t].rowOffsets_.data();
+            tables_[t].columns_ = ownedTables_[t].columns_.data();
+            tables_[t].values_ = ownedTables_[t].values_.data();
+        }
+    }
+
+    ZernikeBasis(const ZernikeBasis &) = delete;
+    ZernikeBasis & operator=(const ZernikeBasis &) = delete;
+
+    /**
+ * Returns the process-wide basis of the given order. The basis is built on the
+ * first request and the same instance is returned to all later callers, so it
+ * can be shared by all worker threads.
+ */
+    static std::shared_ptr<const ZernikeBasis> Get(int _order)
+    {
+        Cache & cache = GetCache();
+
+        std::lock_guard<std::mutex> lock(cache.mutex_);
+
+        auto & basis = cache.bases_[_order];
+
+        if (!basis)
+        {
+            basis = std::make_shared<const ZernikeBasis>(_order);
+        }
+
+        return basis;
+    }
+
+    /**
+ * Makes _basis the process-wide basis of its order, e.g. after Load().
+ */
+    static void Register(std::shared_ptr<const ZernikeBasis> _basis)
+    {
+        Cache & cache = GetCache();
+
+        std::lock_guard<std::mutex> lock(cache.mutex_);
+
+        cache.bases_[_basis->GetOrder()] = std::move(_basis);
+    }
+
+    /**
+ * Writes the basis into a flat binary file: header, row offsets, columns and
+ * values of the real and of the imaginary table, q and c coefficients.
+ * Every array starts at a multiple of 64 bytes.
+ */
+    void Save(const std::string & _path) const
+    {
+        FileHeader header = MakeHeader(order_);
+
+        header.rowCount_ = GetRowCount();
+
+        T1D qs, cs;
+
+        for (const auto & qsN : qs_)
+        {
+            for (const auto & qsNL : qsN)
+            {
+                qs.insert(qs.end(), qsNL.begin(), qsNL.end());
+            }
+        }
+
+        for (const auto & csL : cs_)
+        {
+            cs.insert(cs.end(), csL.begin(), csL.end());
+        }
+
+        header.qsCount_ = qs.size();
+        header.csCount_ = cs.size();
+
+        std::uint64_t pos = sizeof(FileHeader);
+
+        for (int t = 0; t < tableCount; ++t)
+        {
+            header.coeffCount_[t] = tables_[t].rowOffsets_[header.rowCount_];
+            header.rowOffsetsPos_[t] = Align(pos);
+            header.columnsPos_[t] = Align(header.rowOffsetsPos_[t] + (header.rowCount_ + 1) * sizeof(std::uint64_t));
+            header.valuesPos_[t] = Align(header.columnsPos_[t] + header.coeffCount_[t] * sizeof(std::uint32_t));
+            pos = header.valuesPos_[t] + header.coeffCount_[t] * sizeof(T);
+        }
+
+        header.qsPos_ = Align(pos);
+        header.csPos_ = Align(header.qsPos_ + header.qsCount_ * sizeof(T));
+        header.fileSize_ = header.csPos_ + header.csCount_ * sizeof(T);
+
+        std::ofstream output(_path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+
+        if (!output.is_open())
+        {
+            throw std::runtime_error("ZernikeBasis<MomentT>::Save(): cannot open " + _path);
+        }
+
+        auto write = [&output](std::uint64_t _pos, const void * _data, std::uint64_t _size)
+        {
+            static const char zeros[64] = {};
+
+            std::uint64_t pos = static_cast<std::uint64_t>(output.tellp());
+            output.write(zeros, static_cast<std::streamsize>(_pos - pos));
+            output.write(static_cast<const char *>(_data), static_cast<std::streamsize>(_size));
+        };
+
+        write(0, &header, sizeof(header));
+
+        for (int t = 0; t < tableCount; ++t)
+        {
+            write(header.rowOffsetsPos_[t], tables_[t].rowOffsets_, (header.rowCount_ + 1) * sizeof(std::uint64_t));
+            write(header.columnsPos_[t], tables_[t].columns_, header.coeffCount_[t] * sizeof(std::uint32_t));
+            write(header.valuesPos_[t], tables_[t].values_, header.coeffCount_[t] * sizeof(T));
+        }
+
+        write(header.qsPos_, qs.data(), header.qsCount_ * sizeof(T));
+        write(header.csPos_, cs.data(), header.csCount_ * sizeof(T));
+
+        if (!output.good())
+        {
+            throw std::runtime_error("ZernikeBasis<MomentT>::Save(): unexpected IO error. Cannot write to " + _path);
+        }
+    }
+
+    /**
+ * Maps a file written by Save() read-only into memory. The coefficients are
+ * used in place, so all processes mapping the same file share one page-cached
+ * copy. Throws std::runtime_error if the file is not a valid basis of the
+ * given order and MomentT, std::invalid_argument for a negative order.
+ */
+    static std::shared_ptr<const ZernikeBasis> Load(const std::string & _path, int _order)
+    {
+        using namespace boost::interprocess;
+
+        if (_order < 0)
+        {
+            throw std::invalid_argument("ZernikeBasis<MomentT>::Load(): order must be non-negative.");
+        }
+
+        std::shared_ptr<ZernikeBasis> basis(new ZernikeBasis());
+
+        try
+        {
+            file_mapping file(_path.c_str(), read_only);
+            basis->region_ = std::make_shared<mapped_region>(file, read_only);
+        }
+        catch (const interprocess_exception & exc)
+        {
+            throw std::runtime_error("ZernikeBasis<MomentT>::Load(): cannot map " + _path + ": " + exc.what());
+        }
+
+        const char * data = static_cast<const char *>(basis->region_->get_address());
+        std::uint64_t size = basis->region_->get_size();
+
+        const std::string corrupted = "ZernikeBasis<MomentT>::Load(): " + _path + " is corrupted.";
+
+        FileHeader header;
+        FileHeader expected = MakeHeader(_order);
+
+        if (size < sizeof(header))
+        {
+            throw std::runtime_error("ZernikeBasis<MomentT>::Load(): " + _path + " is too small to be a basis file.");
+        }
+
+        std::memcpy(&header, data, sizeof(header));
+
+        if (std::memcmp(header.magic_, expected.magic_, sizeof(header.magic_)) != 0 ||
+            header.byteOrder_ != expected.byteOrder_ ||
+            header.version_ != expected.version_ ||
+            header.valueSize_ != expected.valueSize_ ||
+            header.order_ != expected.order_)
+        {
+            throw std::runtime_error("ZernikeBasis<MomentT>::Load(): " + _path + " is not a basis file of this version, order and moment type.");
+        }
+
+        basis->order_ = _order;
+        basis->ComputeRowIndices();
+
+        std::uint64_t pos = sizeof(FileHeader);
+
+        if (header.fileSize_ != size || header.rowCount_ != basis->GetRowCount())
+        {
+            throw std::runtime_error(corrupted);
+        }
+
+        std::uint32_t momentCount = static_cast<std::uint32_t>(GeometricalMomentCount(_order));
+
+        for (int t = 0; t < tableCount; ++t)
+        {
+            // the arrays follow each other, every one is checked before its end is computed
+            if (!IsArrayInFile<std::uint64_t>(header.rowOffsetsPos_[t], header.rowCount_ + 1, pos, size) ||
+                !IsArrayInFile<std::uint32_t>(header.columnsPos_[t], header.coeffCount_[t], header.rowOffsetsPos_[t] + (header.rowCount_ + 1) * sizeof(std::uint64_t), size) ||
+                !IsArrayInFile<T>(header.valuesPos_[t], header.coeffCount_[t], header.columnsPos_[t] + header.coeffCount_[t] * sizeof(std::uint32_t), size))
+            {
+                throw std::runtime_error(corrupted);
+            }
+
+            pos = header.valuesPos_[t] + header.coeffCount_[t] * sizeof(T);
+
+            Table & table = basis->tables_[t];
+
+            table.rowOffsets_ = reinterpret_cast<const std::uint64_t *>(data + header.rowOffsetsPos_[t]);
+            table.columns_ = reinterpret_cast<const std::uint32_t *>(data + header.columnsPos_[t]);
+            table.values_ = reinterpret_cast<const T *>(data + header.valuesPos_[t]);
+
+            if (table.rowOffsets_[0] != 0 || table.rowOffsets_[header.rowCount_] != header.coeffCount_[t])
+            {
+                throw std::runtime_error(corrupted);
+            }
+
+            for (std::uint64_t row = 0; row < header.rowCount_; ++row)
+            {
+                if (table.rowOffsets_[row] > table.rowOffsets_[row + 1])
+                {
+                    throw std::runtime_error(corrupted);
+                }
+            }
+
+            for (std::uint64_t i = 0; i < header.coeffCount_[t]; ++i)
+            {
+                if (table.columns_[i] >= momentCount)
+                {
+                    throw std::runtime_error(corrupted);
+                }
+            }
+        }
+
+        if (!IsArrayInFile<T>(header.qsPos_, header.qsCount_, pos, size) ||
+            !IsArrayInFile<T>(header.csPos_, header.csCount_, header.qsPos_ + header.qsCount_ * sizeof(T), size))
+        {
+            throw std::runtime_error(corrupted);
+        }
+
+        // q and c coefficients are small, they are copied
+        const T * qs = reinterpret_cast<const T *>(data + header.qsPos_);
+        const T * cs = reinterpret_cast<const T *>(data + header.csPos_);
+
+        basis->qs_.resize(_order + 1);
+        basis->cs_.resize(_order + 1);
+
+        for (int n = 0; n <= _order; ++n)
+        {
+            basis->qs_[n].resize(n / 2 + 1);
+
+            for (int l = n % 2; l <= n; l += 2)
+            {
+                basis->qs_[n][l / 2].resize((n - l) / 2 + 1);
+            }
+
+            basis->cs_[n].resize(n + 1);
+        }
+
+        std::uint64_t qsIndex = 0, csIndex = 0;
+
+        for (auto & qsN : basis->qs_)
+        {
+            for (auto & qsNL : qsN)
+            {
+                for (auto & q : qsNL)
+                {
+                    if (qsIndex == header.qsCount_)
+                    {
+                        throw std::runtime_error(corrupted);
+                    }
+
+                    q = qs[qsIndex++];
+                }
+            }
+        }
+
+        for (auto & csL : basis->cs_)
+        {
+            for (auto & c : csL)
+            {
+                if (csIndex == header.csCount_)
+                {
+                    throw std::runtime_error(corrupted);
+                }
+
+                c = cs[csIndex++];
+            }
+        }
+
+        // the file has to hold exactly the coefficients of the order
+        if (qsIndex != header.qsCount_ || csIndex != header.csCount_)
+        {
+            throw std::runtime_error(corrupted);
+        }
+
+        return basis;
+    }
+
+    int GetOrder() const
+    {
+        return order_;
+    }
+
+    /**
+ * Index of the row of the Zernike moment [n,l,m], m >= 0. l is passed as
+ * index li = l / 2. Rows are ordered by n, l and m.
+ */
+    std::size_t GetRowIndex(int _n, int _li, int _m) const
+    {
+        return rowIndices_[_n][_li] + _m;
+    }
+
+    /// Number of the Zernike moments [n,l,m] with m >= 0
+    std::size_t GetRowCount() const
+    {
+        return rowIndices_.back().back() + order_ + 1;
+    }
+
+    /// The purely real coefficients, values are the real parts
+    const Table & GetRealTable() const
+    {
+        return tables_[realTable];
+    }
+
+    /// The purely imaginary coefficients, values are the imaginary parts
+    const Table & GetImagTable() const
+    {
+        return tables_[imagTable];
+    }
+
+    /**
+ * Number of terms per order n that were merged away because they refer to the
+ * same geometrical moment as another term of their row. Empty for a loaded
+ * basis, its tables were compacted when the file was saved.
+ */
+    const vector<std::uint64_t> & GetRemovedTermCounts() const
+    {
+        return removedTermCounts_;
+    }
+
+    /// q coefficient (radial polynomial normalization), l is passed as index li = l / 2
+    T GetQ(int _n, int _li, int _mu) const
+    {
+        return static_cast<T>(qs_[_n][_li][_mu]);
+    }
+
+    /// c coefficient (harmonic polynomial normalization)
+    T GetC(int _l, int _m) const
+    {
+        return static_cast<T>(cs_[_l][_m]);
+    }
+
+private:
+    // ---- private types ----
+    enum
+    {
+        realTable = 0,
+        imagTable = 1,
+        tableCount = 2
+    };
+
+    struct FileHeader
+    {
+        char            magic_[8];
+        std::uint32_t   byteOrder_;
+        std::uint32_t   version_;
+        std::uint32_t   valueSize_;         // sizeof(MomentT)
+        std::int32_t    order_;
+        std::uint64_t   rowCount_;
+        std::uint64_t   qsCount_;
+        std::uint64_t   csCount_;
+        std::uint64_t   coeffCount_[tableCount];
+        std::uint64_t   rowOffsetsPos_[tableCount];     // byte offsets from the start of the file
+        std::uint64_t   columnsPos_[tableCount];
+        std::uint64_t   valuesPos_[tableCount];
+        std::uint64_t   qsPos_;
+        std::uint64_t   csPos_;
+        std::uint64_t   fileSize_;
+    };
+
+    struct OwnedTable
+    {
+        vector<std::uint64_t>   rowOffsets_;
+        vector<std::uint32_t>   columns_;
+        T1D                     values_;
+    };
+
+    struct Cache
+    {
+        std::mutex mutex_;
+        std::map<int, std::shared_ptr<const ZernikeBasis> > bases_;
+    };
+
+    // ---- private member functions ----
+    /// Used by Load()
+    ZernikeBasis() :
+        tables_{}, binomials_(0), order_(0), threadCount_(1)
+    {
+    }
+
+    static Cache & GetCache()
+    {
+        static Cache cache;
+        return cache;
+    }
+
+    static FileHeader MakeHeader(int _order)
+    {
+        FileHeader header{};
+
+        std::memcpy(header.magic_, "Z3DBASIS", sizeof(header.magic_));
+        header.byteOrder_ = 0x01020304;
+        header.version_ = fileVersion;
+        header.valueSize_ = sizeof(T);
+        header.order_ = _order;
+
+        return header;
+    }
+
+    static std::uint64_t Align(std::uint64_t _pos)
+    {
+        return (_pos + 63) / 64 * 64;
+    }
+
+    /**
+ * Checks an array of a file read by Load(): _count values of ElementT at the
+ * byte offset _pos lie within [_begin, _size) and are aligned for ElementT,
+ * the mapping itself starts at a page. The count is bounded before the size of
+ * the array is computed, so the counts of a corrupted header cannot overflow.
+ */
+    template<class ElementT>
+    static bool IsArrayInFile(std::uint64_t _pos, std::uint64_t _count, std::uint64_t _begin, std::uint64_t _size)
+    {
+        return _pos >= _begin && _pos <= _size &&
+            _pos % alignof(ElementT) == 0 &&
+            _count <= (_size - _pos) / sizeof(ElementT);
+    }
+
+    /**
+ * Computes the index of the first row ([n,l,0]) of each (n,l) in the flat table.
+ */
+    void ComputeRowIndices()
+    {
+        std::size_t row = 0;
+
+        rowIndices_.resize(order_ + 1);
+
+        for (int n = 0; n <= order_; ++n)
+        {
+            rowIndices_[n].resize(n / 2 + 1);
+
+            for (int l = n % 2; l <= n; l += 2)
+            {
+                rowIndices_[n][l / 2] = row;
+                row += l + 1;
+            }
+        }
+    }
+
+/**
+ * Computes all the normalizing factors $c_l^m$ for harmonic polynomials e
+ */
+    void ComputeCs()
+    {
+        /*
+         indexing:
+           l goes from 0 to n
+           m goes from -l to l, in fact from 0 to l, since c(l,-m) = c (l,m)
+        */
+
+        cs_.resize(order_ + 1);
+
+        // high l first, they have the most coefficients
+        ParallelFor(order_ + 1, [this](std::size_t _item)
+        {
+            size_t l = order_ - _item;
+
+            cs_[l].resize(l + 1);
+            for (size_t m = 0; m <= l; ++m)
+            {
+                // (l+m)! (l-m)! / (l!)^2 = C(2l,l) / C(2l,l+m)
+                CoefficientT n_sqrt = static_cast<CoefficientT>(2 * l + 1) * binomials_.Get(2 * l, l);
+                CoefficientT d_sqrt = binomials_.Get(2 * l, l + m);
+
+                cs_[l][m] = std::sqrt(n_sqrt / d_sqrt);
+            }
+        });
+    }
+
+    /**
+ * Computes all coefficients q for orthonormalization of radial polynomials
+ * in Zernike polynomials.
+ */
+    void ComputeQs()
+    {
+        /*
+         indexing:
+           n goes 0..order_
+           l goes 0..n, so that n-l is even
+           mu goes 0..(n-l)/2
+        */
+
+        qs_.resize(order_ + 1);            // there is order_ + 1 n's
+
+        // high n first, they have the most coefficients
+        ParallelFor(order_ + 1, [this](std::size_t _item)
+        {
+            size_t n = order_ - _item;
+
+            qs_[n].resize(n / 2 + 1);      // there is floor(n/2) + 1 l's
+
+            size_t l0 = n % 2;
+            for (size_t l = l0; l <= n; l += 2)
+            {
+                size_t k = (n - l) / 2;
+
+                qs_[n][l / 2].resize(k + 1);   // there is k+1 mu's
+
+                for (size_t mu = 0; mu <= k; ++mu)
+                {
+                    CoefficientT nom = binomials_.Get(2 * k, k) * // nominator of straight part
+                        binomials_.Get(k, mu) * binomials_.Get(2 * (k + l + mu) + 1, 2 * k);
+
+                    if ((k + mu) % 2)
+                    {
+                        nom *= static_cast<CoefficientT>(-1);
+                    }
+
+                    CoefficientT den = BinomialTable<CoefficientT>::PowerOfTwo(2 * k) *     // denominator of straight part
+                        binomials_.Get(k + l + mu, k);
+
+                    CoefficientT n_sqrt = static_cast<CoefficientT>(2 * l + 4 * k + 3);      // nominator of sqrt part
+                    CoefficientT d_sqrt = static_cast<CoefficientT>(3);                        // denominator of sqrt part
+
+                    qs_[n][l / 2][mu] = nom / den * std::sqrt(n_sqrt / d_sqrt);
+                }
+            }
+        });
+    }
+
+    /**
+ * Computes the coefficients of geometrical moments in linear combinations
+ * yielding the Zernike moments for each applicable [n,l,m] for n<=order_.
+ * For each such combination the coefficients are stored with according
+ * geom. moment index (see GeometricalMomentIndex()).
+ * The rows of every pair (n,l) are computed independently on the worker
+ * threads and concatenated in the order of the rows afterwards.
+ */
+    void ComputeGCoefficients()
+    {
+        struct Block
+        {
+            size_t          n_, li_;
+            OwnedTable      tables_[tableCount];    // row offsets relative to the block
+            std::uint64_t   removedTermCount_;
+        };
+
+        vector<Block> blocks;
+
+        for (int n = 0; n <= order_; ++n)
+        {
+            for (int li = 0; li <= n / 2; ++li)
+            {
+                blocks.push_back(Block{ static_cast<size_t>(n), static_cast<size_t>(li), {}, 0 });
+            }
+        }
+
+        // high n first, the work grows steeply with n
+        ParallelFor(blocks.size(), [this, &blocks](std::size_t _item)
+        {
+            Block & block = blocks[blocks.size() - 1 - _item];
+            block.removedTermCount_ = ComputeGCoefficientRows(block.n_, block.li_, block.tables_);
+        });
+
+        for (auto & table : ownedTables_)
+        {
+            table = OwnedTable();
+        }
+
+        removedTermCounts_.assign(order_ + 1, 0);
+
+        for (const Block & block : blocks)
+        {
+            for (int t = 0; t < tableCount; ++t)
+            {
+                const OwnedTable & blockTable = block.tables_[t];
+                OwnedTable & table = ownedTables_[t];
+
+                std::uint64_t offset = table.values_.size();
+
+                for (std::uint64_t rowOffset : blockTable.rowOffsets_)
+                {
+                    table.rowOffsets_.push_back(offset + rowOffset);
+                }
+
+                table.columns_.insert(table.columns_.end(), blockTable.columns_.begin(), blockTable.columns_.end());
+                table.values_.insert(table.values_.end(), blockTable.values_.begin(), blockTable.values_.end());
+            }
+
+            removedTermCounts_[block.n_] += block.removedTermCount_;
+        }
+
+        for (auto & table : ownedTables_)
+        {
+            table.rowOffsets_.push_back(table.values_.size());
+        }
+    }
+
+    /**
+ * Computes the rows [n,l,m], m = 0..l, of one pair (n,l) into _tables. Only the
+ * offsets of the row starts are stored. Returns the number of merged terms.
+ */
+    std::uint64_t ComputeGCoefficientRows(size_t _n, size_t _li, OwnedTable (&_tables)[tableCount]) const
+    {
+        std::uint64_t removedTermCount = 0;
+        const size_t n = _n, li = _li, l = 2 * li + n % 2;
+
+        // terms of the current row with the same geometrical moment are summed up
+        std::map<std::uint32_t, CoefficientT> rowTerms[tableCount];
+
+        for (size_t m = 0; m <= l; ++m)
+        {
+            for (int t = 0; t < tableCount; ++t)
+            {
+                _tables[t].rowOffsets_.push_back(_tables[t].values_.size());
+                rowTerms[t].clear();
+            }
+
+            CoefficientT w = cs_[l][m] / BinomialTable<CoefficientT>::PowerOfTwo(m);
+
+            size_t k = (n - l) / 2;
+            for (size_t nu = 0; nu <= k; ++nu)
+            {
+                CoefficientT w_Nu = w * qs_[n][li][nu];
+                for (size_t alpha = 0; alpha <= nu; ++alpha)
+                {
+                    CoefficientT w_NuA = w_Nu * binomials_.Get(nu, alpha);
+                    for (size_t beta = 0; beta <= nu - alpha; ++beta)
+                    {
+                        CoefficientT w_NuAB = w_NuA * binomials_.Get(nu - alpha, beta);
+                        for (size_t p = 0; p <= m; ++p)
+                        {
+                            CoefficientT w_NuABP = w_NuAB * binomials_.Get(m, p);
+                            for (size_t mu = 0; mu <= (l - m) / 2; ++mu)
+                            {
+                                CoefficientT w_NuABPMu = w_NuABP *
+                                    binomials_.Get(l, mu) *
+                                    binomials_.Get(l - mu, m + mu) /
+                                    BinomialTable<CoefficientT>::PowerOfTwo(2 * mu);
+                                for (size_t q = 0; q <= mu; ++q)
+                                {
+                                    // the absolute value of the coefficient
+                                    CoefficientT w_NuABPMuQ = w_NuABPMu * binomials_.Get(mu, q);
+
+                                    // the sign
+                                    if ((m - p + mu) % 2)
+                                    {
+                                        w_NuABPMuQ *= static_cast<CoefficientT>(-1);
+                                    }
+
+                                    // * i^p
+                                    // c = w * i^p is purely real for even p and purely imaginary for odd p
+                                    size_t rest = p % 4;
+                                    std::map<std::uint32_t, CoefficientT> & terms = rowTerms[rest % 2 == 0 ? realTable : imagTable];
+                                    CoefficientT c = rest < 2 ? w_NuABPMuQ : static_cast<CoefficientT>(-1) * w_NuABPMuQ;
+
+                                    // determination of the order of according moment
+                                    int z_i = l - m + 2 * (nu - alpha - beta - mu);
+                                    int y_i = 2 * (mu - q + beta) + m - p;
+                                    int x_i = 2 * q + p + 2 * alpha;
+                                    //DD
+                                                                            //std::cout << x_i << " " << y_i << " " << z_i;
+                                                                            //std::cout << "\t" << n << " " << l << " " << m;
+                                                                            //std::cout << "\t" << c << std::endl;
+                                    //DD
+                                    terms[static_cast<std::uint32_t>(GeometricalMomentIndex(x_i, y_i, z_i))] += c;
+                                    removedTermCount++;
+                                } // q
+                            } // mu
+                        } // p
+                    } // beta
+                } // alpha
+            } // nu
+
+            // the columns of a row are ascending
+            for (int t = 0; t < tableCount; ++t)
+            {
+                for (const auto & term : rowTerms[t])
+                {
+                    _tables[t].columns_.push_back(term.first);
+                    _tables[t].values_.push_back(static_cast<T>(term.second));
+                }
+
+                removedTermCount -= rowTerms[t].size();
+            }
+        } // m
+
+        return removedTermCount;
+    }
+
+    /**
+ * Calls _function(i) for i = 0.._count-1 on threadCount_ threads. The items are
+ * handed out one by one in ascending order, so expensive items should come
+ * first. The first exception thrown by _function is rethrown.
+ */
+    template<class Function>
+    void ParallelFor(std::size_t _count, Function _function) const
+    {
+        std::atomic<std::size_t> next(0);
+        std::exception_ptr error;
+        std::mutex errorMutex;
+
+        auto work = [&]()
+        {
+            try
+            {
+                for (std::size_t item = next++; item < _count; item = next++)
+                {
+                    _function(item);
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(errorMutex);
+
+                if (!error)
+                {
+                    error = std::current_exception();
+                }
+
+                next = _count;
+            }
+        };
+
+        vector<std::thread> threads;
+
+        for (unsigned i = 1; i < std::min<std::size_t>(threadCount_, _count); ++i)
+        {
+            threads.emplace_back(work);
+        }
+
+        work();
+
+        for (auto & thread : threads)
+        {
+            thread.join();
+        }
+
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // ---- private attributes -----
+    Table                   tables_[tableCount];    // real and imaginary coefficients of the geometric moments
+    vector<vector<std::size_t> > rowIndices_;   // index of the row [n,l,0]
+
+    OwnedTable              ownedTables_[tableCount];   // storage of a computed basis
+    vector<std::uint64_t>   removedTermCounts_;         // merged terms per order n, see GetRemovedTermCounts()
+    std::shared_ptr<boost::interprocess::mapped_region> region_;    // storage of a loaded basis
+
+    BinomialTable<CoefficientT> binomials_; // C(n,k) for n <= 2 * order_ + 1, used to compute the coefficients
+    vector<vector<vector<CoefficientT> > > qs_; // q coefficients (radial polynomial normalization)
+    vector<vector<CoefficientT> > cs_;      // c coefficients (harmonic polynomial normalization)
+    int                 order_;             // := max{n} according to indexing of Zernike polynomials
+    unsigned            threadCount_;       // number of threads computing the coefficients
+};
\ No newline at end of file
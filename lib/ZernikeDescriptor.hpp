@@ -42,19 +42,36 @@ for more information, see the paper:
 #pragma once
 
 // ---- std includes ---
-#include "stdafx.h"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
 
 // ---- local program includes ----
 //#include "GeometricalMoments.h"
+#include "BitVoxelGrid.hpp"
+#include "BrickVoxelGrid.hpp"
 #include "ScaledGeometricMoments.hpp"
+#include "ThreadPool.hpp"
+#include "VoxelEdit.hpp"
+#include "VoxelSegments.hpp"
 #include "ZernikeMoments.hpp"
 
 /**
  * This class serves as a wrapper around the geometrical and
  * Zernike moments. It provides also the implementation of invariant Zernike
  * descriptors, means of reconstruction of orig. function, etc.
+ * ZernikeMomentsType may be FixedZernikeMoments<N, ...> for orders with
+ * compile-time coefficient tables.
  */
-template<class T, class InputVoxelIterator>
+template<class T, class InputVoxelIterator, class ZernikeMomentsType = ZernikeMoments<InputVoxelIterator, T> >
 class ZernikeDescriptor
 {
 public:
@@ -71,19 +88,438 @@ public:
 
     //typedef CumulativeMoments<T, T>                 CumulativeMomentsT;
     typedef ScaledGeometricalMoments<InputVoxelIterator, T>          ScaledGeometricalMomentsT;
-    typedef ZernikeMoments<InputVoxelIterator, T>                    ZernikeMomentsT;
+    typedef ZernikeMomentsType                                       ZernikeMomentsT;
+
+    /**
+        Center of gravity and scale of a grid, see GetNormalization(). A stored
+        normalization saves the first pass over the grid when the descriptor of
+        the same grid is computed again, e.g. for a higher order.
+     */
+    struct Normalization
+    {
+        size_t  xDim_, yDim_, zDim_;        // edges of the voxel grid
+        T       zeroMoment_;                // zero order moment
+        T       xCOG_, yCOG_, zCOG_;        // center of gravity
+        T       scale_;                     // scaling factor mapping the function into the unit sphere
+    };
 
     // ---- public functions ----
     ZernikeDescriptor(
         InputVoxelIterator voxels, /**< the cubic voxel grid */
         size_t _dim,                   /**< dimension is $_dim^3$ */
-        size_t _order                  /**< maximal order of the Zernike moments (N in paper) */
-    ) : dim_(_dim), order_(_order)
+        size_t _order,                 /**< maximal order of the Zernike moments (N in paper) */
+        bool _deferZernike = false,    /**< stop after the geometrical moments, see ComputeBatch() */
+        GeometricalMomentsEngine _engine = GeometricalMomentsEngine::diff,  /**< algorithm of the geometrical moments */
+        ThreadPool * _pool = nullptr,  /**< threads for the z-slabs of a large grid, none if nullptr */
+        const Normalization * _normalization = nullptr,    /**< normalization of the grid if it is known, see GetNormalization() */
+        bool _occupancy = false        /**< the voxels are fractional occupancies, e.g. of VoxelPyramid, see ComputeScale_RadiusVar() */
+    ) : ZernikeDescriptor(voxels, _dim, _dim, _dim, _order, _deferZernike, _engine, _pool, _normalization, _occupancy)
+    {
+    }
+
+    /**
+        Computes the descriptor of a box-shaped voxel grid, the voxel (x, y, z)
+        has the index (z * _yDim + y) * _xDim + x. The unit ball is placed as for
+        a cubic grid, so the descriptor equals the one of the grid padded with
+        empty voxels to a cube, but the cost depends on the voxels of the box only.
+        After one pass which finds the box around the set voxels, see
+        FindOccupiedBox(), all stages run on that box, so a small object in a
+        large grid costs what its extent costs.
+     */
+    ZernikeDescriptor(
+        InputVoxelIterator voxels, /**< the voxel grid */
+        size_t _xDim,                  /**< x-dimension of the grid */
+        size_t _yDim,                  /**< y-dimension of the grid */
+        size_t _zDim,                  /**< z-dimension of the grid */
+        size_t _order,                 /**< maximal order of the Zernike moments (N in paper) */
+        bool _deferZernike = false,    /**< stop after the geometrical moments, see ComputeBatch() */
+        GeometricalMomentsEngine _engine = GeometricalMomentsEngine::diff,  /**< algorithm of the geometrical moments */
+        ThreadPool * _pool = nullptr,  /**< threads for the z-slabs of a large grid, none if nullptr */
+        const Normalization * _normalization = nullptr,    /**< normalization of the grid if it is known, see GetNormalization() */
+        bool _occupancy = false        /**< the voxels are fractional occupancies, e.g. of VoxelPyramid, see ComputeScale_RadiusVar() */
+    ) : order_(_order), xDim_(_xDim), yDim_(_yDim), zDim_(_zDim)
+    {
+        const VoxelBox box = FindOccupiedBox(voxels, static_cast<int>(xDim_), static_cast<int>(yDim_), static_cast<int>(zDim_));
+
+        if (_normalization != nullptr)
+        {
+            SetNormalization(*_normalization);
+        }
+        else
+        {
+            ComputeNormalization(voxels, box, _pool, _occupancy);
+        }
+
+        NormalizeGrid(voxels, box, _pool);
+        ComputeMoments(voxels, box, !_deferZernike, _engine, _pool);
+
+        if (!_deferZernike)
+        {
+            ComputeInvariants();
+        }
+    }
+
+    /**
+        Computes the descriptor of a binary grid given as segments along y, see
+        VoxelSegments. It equals the descriptor of the according dense grid up to
+        rounding, but the cost depends on the number of segments, not on dim^3.
+     */
+    ZernikeDescriptor(
+        const VoxelSegments & _segments,   /**< the cubic binary voxel grid */
+        size_t _order,                     /**< maximal order of the Zernike moments (N in paper) */
+        bool _deferZernike = false,        /**< stop after the geometrical moments, see ComputeBatch() */
+        const Normalization * _normalization = nullptr     /**< normalization of the grid if it is known, see GetNormalization() */
+    ) : order_(_order), xDim_(_segments.GetDim()), yDim_(xDim_), zDim_(xDim_)
+    {
+        if (_normalization != nullptr)
+        {
+            SetNormalization(*_normalization);
+        }
+        else
+        {
+            ComputeNormalization(_segments);
+        }
+
+        gm_.InitFromSegments(NormalizeGrid(_segments), xCOG_, yCOG_, zCOG_, scale_, order_);
+
+        if (!_deferZernike)
+        {
+            ComputeZernikeMoments();
+            ComputeInvariants();
+        }
+    }
+
+    /**
+        Computes the descriptor of a bit-packed binary grid, see BitVoxelGrid. It
+        equals the descriptor of the according dense grid up to rounding. The
+        voxels outside of the unit ball are cleared, as in the dense version.
+     */
+    ZernikeDescriptor(
+        BitVoxelGrid & _grid,          /**< the cubic binary voxel grid */
+        size_t _order,                 /**< maximal order of the Zernike moments (N in paper) */
+        bool _deferZernike = false,    /**< stop after the geometrical moments, see ComputeBatch() */
+        const Normalization * _normalization = nullptr     /**< normalization of the grid if it is known, see GetNormalization() */
+    ) : order_(_order), xDim_(_grid.GetDim()), yDim_(xDim_), zDim_(xDim_)
+    {
+        if (_normalization != nullptr)
+        {
+            SetNormalization(*_normalization);
+        }
+        else
+        {
+            ComputeNormalization(_grid);
+        }
+
+        NormalizeGrid(_grid);
+        gm_.InitFromBits(_grid, xCOG_, yCOG_, zCOG_, scale_, order_);
+
+        if (!_deferZernike)
+        {
+            ComputeZernikeMoments();
+            ComputeInvariants();
+        }
+    }
+
+    /**
+        Computes the descriptor of a sparse brick grid, see BrickVoxelGrid. It
+        equals the descriptor of the according dense grid up to rounding. The
+        bricks outside of the unit ball are cleared and the ones crossing its
+        surface are clipped line by line, the cost depends on the number of the
+        mixed bricks and the full bricks, not on dim^3.
+     */
+    ZernikeDescriptor(
+        BrickVoxelGrid & _grid,        /**< the cubic binary voxel grid */
+        size_t _order,                 /**< maximal order of the Zernike moments (N in paper) */
+        bool _deferZernike = false,    /**< stop after the geometrical moments, see ComputeBatch() */
+        const Normalization * _normalization = nullptr     /**< normalization of the grid if it is known, see GetNormalization() */
+    ) : order_(_order), xDim_(_grid.GetDim()), yDim_(xDim_), zDim_(xDim_)
     {
-        ComputeNormalization(voxels);
-        NormalizeGrid(voxels);
-        ComputeMoments(voxels);
-        ComputeInvariants();
+        if (_normalization != nullptr)
+        {
+            SetNormalization(*_normalization);
+        }
+        else
+        {
+            VoxelSums sums;
+            sums.Add(_grid);
+
+            ComputeNormalization(sums);
+        }
+
+        NormalizeGrid(_grid);
+        gm_.InitFromBricks(_grid, xCOG_, yCOG_, zCOG_, scale_, order_);
+
+        if (!_deferZernike)
+        {
+            ComputeZernikeMoments();
+            ComputeInvariants();
+        }
+    }
+
+    /**
+        Computes the descriptor of a binary grid which is read plane by plane, e.g.
+        directly from a file, so only one plane is kept in memory. _reader is called
+        twice, for the normalization and for the moments, or once if the normalization
+        is known. The descriptor equals the one of the segment grid of all planes.
+     */
+    ZernikeDescriptor(
+        const VoxelSegmentsReader & _reader,   /**< gives the planes of the cubic binary voxel grid */
+        size_t _order,                         /**< maximal order of the Zernike moments (N in paper) */
+        bool _deferZernike = false,            /**< stop after the geometrical moments, see ComputeBatch() */
+        const Normalization * _normalization = nullptr     /**< normalization of the grid if it is known, see GetNormalization() */
+    ) : order_(_order), xDim_(0), yDim_(0), zDim_(0)
+    {
+        if (_normalization != nullptr)
+        {
+            xDim_ = _normalization->xDim_;
+            yDim_ = _normalization->yDim_;
+            zDim_ = _normalization->zDim_;
+
+            if (!IsCubic())
+            {
+                throw std::invalid_argument("ZernikeDescriptor: the planes of a grid need a cubic normalization.");
+            }
+
+            SetNormalization(*_normalization);
+        }
+        else
+        {
+            VoxelSums sums;
+
+            _reader([this, &sums](const VoxelSegments & _plane)
+            {
+                xDim_ = yDim_ = zDim_ = _plane.GetDim();
+                sums.Add(_plane);
+            });
+
+            ComputeNormalization(sums);
+        }
+
+        gm_.BeginSegments(static_cast<int>(xDim_), xCOG_, yCOG_, zCOG_, scale_, static_cast<int>(order_));
+
+        _reader([this](const VoxelSegments & _plane)
+        {
+            if (static_cast<size_t>(_plane.GetDim()) != xDim_)
+            {
+                throw std::runtime_error("ZernikeDescriptor: the planes do not match the normalization of the grid.");
+            }
+
+            gm_.AddSegments(NormalizeGrid(_plane));
+        });
+
+        gm_.EndSegments();
+
+        if (!_deferZernike)
+        {
+            ComputeZernikeMoments();
+            ComputeInvariants();
+        }
+    }
+
+    /**
+        Computes the descriptor from the geometrical moments of an earlier
+        computation of the same grid, see GetGeometricalMoments() and
+        GetNormalization(). The grid itself is not needed. _moments has to contain
+        the moments up to _order at least, higher orders are ignored.
+     */
+    ZernikeDescriptor(
+        const T1D & _moments,                  /**< geometrical moments, see GeometricalMomentIndex() */
+        const Normalization & _normalization,  /**< normalization the moments were computed with */
+        size_t _order,                         /**< maximal order of the Zernike moments (N in paper) */
+        bool _deferZernike = false             /**< stop after the geometrical moments, see ComputeBatch() */
+    ) : order_(_order), xDim_(_normalization.xDim_), yDim_(_normalization.yDim_), zDim_(_normalization.zDim_)
+    {
+        if (_moments.size() < GeometricalMomentCount(static_cast<int>(_order)))
+        {
+            throw std::invalid_argument("ZernikeDescriptor: the geometrical moments do not reach the order of the descriptor.");
+        }
+
+        SetNormalization(_normalization);
+        gm_.InitFromMoments(_moments.data(), static_cast<int>(order_));
+
+        if (!_deferZernike)
+        {
+            ComputeZernikeMoments();
+            ComputeInvariants();
+        }
+    }
+
+    /**
+        Computes the descriptor of an edited binary grid from the geometrical
+        moments and the normalization of the original grid, see
+        GetGeometricalMoments() and GetNormalization(). The moments of the set
+        voxels are added and the ones of the cleared voxels are subtracted. The
+        new center of gravity and scale follow from the old ones and the changed
+        voxels, the moments are transformed to them with Recenter(). As the
+        voxels outside the unit ball are cut off, the voxels of the edited grid
+        between the old and the new ball are added or subtracted as well, so
+        _voxels is read only in this shell. The result equals the descriptor of
+        the edited grid up to rounding and can be the original of the next edit.
+     */
+    ZernikeDescriptor(
+        const T1D & _moments,                  /**< geometrical moments of the original grid, see GeometricalMomentIndex() */
+        const Normalization & _normalization,  /**< normalization of the original grid */
+        const VoxelEdit & _edit,               /**< changes of the original grid */
+        InputVoxelIterator _voxels,            /**< the edited cubic voxel grid, it is not modified */
+        size_t _order,                         /**< maximal order of the Zernike moments (N in paper) */
+        bool _deferZernike = false             /**< stop after the geometrical moments, see ComputeBatch() */
+    ) : order_(_order), xDim_(_normalization.xDim_), yDim_(_normalization.yDim_), zDim_(_normalization.zDim_)
+    {
+        if (_moments.size() < GeometricalMomentCount(static_cast<int>(_order)))
+        {
+            throw std::invalid_argument("ZernikeDescriptor: the geometrical moments do not reach the order of the descriptor.");
+        }
+
+        if (static_cast<size_t>(_edit.GetDim()) != xDim_ || !IsCubic())
+        {
+            throw std::invalid_argument("ZernikeDescriptor: the edit belongs to a grid of another dimension.");
+        }
+
+        SetNormalization(_normalization);
+        gm_.InitFromMoments(_moments.data(), static_cast<int>(order_));
+
+        // the changed voxels inside the old ball
+        AddSegmentMoments(NormalizeGrid(_edit.GetSet()), static_cast<T>(1));
+        AddSegmentMoments(NormalizeGrid(_edit.GetCleared()), static_cast<T>(-1));
+
+        VoxelSums set, cleared;
+        set.Add(_edit.GetSet());
+        cleared.Add(_edit.GetCleared());
+
+        if (set.count_ != 0 || cleared.count_ != 0)
+        {
+            UpdateNormalization(set, cleared);
+        }
+
+        if (xCOG_ != _normalization.xCOG_ || yCOG_ != _normalization.yCOG_ || zCOG_ != _normalization.zCOG_ || scale_ != _normalization.scale_)
+        {
+            gm_.Recenter(
+                (_normalization.xCOG_ - xCOG_) * _normalization.scale_,
+                (_normalization.yCOG_ - yCOG_) * _normalization.scale_,
+                (_normalization.zCOG_ - zCOG_) * _normalization.scale_,
+                static_cast<double>(scale_) / _normalization.scale_);
+
+            AddBallShell(_voxels, _normalization);
+        }
+
+        if (!_deferZernike)
+        {
+            ComputeZernikeMoments();
+            ComputeInvariants();
+        }
+    }
+
+    /**
+        Computes the Zernike moments and the invariants of several descriptors
+        constructed with _deferZernike = true. The Zernike moments of all of them
+        are computed in one pass over the basis. All descriptors must have the same order.
+     */
+    static void ComputeBatch(
+        ZernikeDescriptor * const * _descriptors,  /**< descriptors of the batch */
+        std::size_t _count                         /**< size of the batch */
+    )
+    {
+        if (_count == 0)
+        {
+            return;
+        }
+
+        std::size_t order = _descriptors[0]->order_;
+        std::size_t momentCount = GeometricalMomentCount(static_cast<int>(order));
+
+        // dense matrix of the geometrical moments, one column per object
+        T1D moments(momentCount * _count);
+        vector<ZernikeMomentsT *> zms(_count);
+
+        for (std::size_t b = 0; b < _count; ++b)
+        {
+            if (_descriptors[b]->order_ != order)
+            {
+                throw std::invalid_argument("ZernikeDescriptor::ComputeBatch(): all descriptors of a batch must have the same order.");
+            }
+
+            const T1D & gm = _descriptors[b]->gm_.GetMoments();
+
+            for (std::size_t i = 0; i < momentCount; ++i)
+            {
+                moments[i * _count + b] = gm[i];
+            }
+
+            zms[b] = &_descriptors[b]->zm_;
+            zms[b]->Init(static_cast<int>(order));
+        }
+
+        ZernikeMomentsT::ComputeBatch(moments.data(), _count, zms.data());
+
+        for (std::size_t b = 0; b < _count; ++b)
+        {
+            _descriptors[b]->ComputeInvariants();
+        }
+    }
+
+    /**
+        Computes the descriptors of several binary cubic grids of the same
+        dimension. The normalization of every grid comes from the exact sums
+        over its voxels as for the segment grids, the geometrical moments are
+        computed one grid per SIMD lane, see ScaledGeometricalMoments::InitLanes(),
+        and the Zernike moments of all grids with ComputeBatch(). Meant for many
+        small grids, e.g. 32^3, whose loops do not fill the registers. The
+        voxels outside the unit ball are skipped, the grids are not modified.
+     */
+    static vector<ZernikeDescriptor> ComputeLanes(
+        const InputVoxelIterator * _voxels,    /**< the cubic voxel grids */
+        std::size_t _count,                    /**< number of the grids */
+        size_t _dim,                           /**< dimension of every grid is $_dim^3$ */
+        size_t _order,                         /**< maximal order of the Zernike moments (N in paper) */
+        bool _deferZernike = false             /**< stop after the geometrical moments, see ComputeBatch() */
+    )
+    {
+        using Placement = typename ScaledGeometricalMomentsT::Placement;
+
+        vector<ZernikeDescriptor> descriptors;
+        vector<Placement> placements;
+
+        descriptors.reserve(_count);
+        placements.reserve(_count);
+
+        for (std::size_t b = 0; b < _count; ++b)
+        {
+            descriptors.push_back(ZernikeDescriptor(_order, _dim));
+
+            ZernikeDescriptor & descriptor = descriptors.back();
+
+            VoxelSums sums;
+            sums.Add(_voxels[b], static_cast<int>(_dim));
+
+            descriptor.ComputeNormalization(sums);
+
+            placements.push_back(Placement{ descriptor.xCOG_, descriptor.yCOG_, descriptor.zCOG_, descriptor.scale_ });
+        }
+
+        vector<ScaledGeometricalMomentsT *> moments;
+        vector<ZernikeDescriptor *> pointers;
+
+        for (auto & descriptor : descriptors)
+        {
+            moments.push_back(&descriptor.gm_);
+            pointers.push_back(&descriptor);
+        }
+
+        ScaledGeometricalMomentsT::InitLanes(_voxels, placements.data(), _count,
+            static_cast<int>(_dim), static_cast<int>(_dim), static_cast<int>(_dim), static_cast<int>(_order), moments.data(), true);
+
+        if (!_deferZernike)
+        {
+            ComputeBatch(pointers.data(), pointers.size());
+        }
+
+        return descriptors;
+    }
+
+    /// Number of the grids which ComputeLanes() computes at once, other counts leave lanes empty
+    static std::size_t LaneCount()
+    {
+        return static_cast<std::size_t>(LaneKernels<T>::Get().lanes_);
     }
 
     /**
@@ -98,7 +534,7 @@ public:
     )
     {
         // the scaling between the reconstruction and original grid
-        T fac = (T)(_grid.size()) / (T)dim_;
+        T fac = (T)(_grid.size()) / (T)std::max({ xDim_, yDim_, zDim_ });
 
         zm_.Reconstruct(_grid,         // result grid
             xCOG_ * fac,     // center of gravity properly scaled
@@ -153,55 +589,130 @@ public:
         return invariants_;
     }
 
+    /**
+        The invariants up to _order, they equal the invariants of a descriptor of
+        that order. The invariants of an order come first, so a descriptor of the
+        highest order gives the ones of all lower orders.
+     */
+    T1D get_invariants(size_t _order) const
+    {
+        if (_order > order_)
+        {
+            throw std::invalid_argument("ZernikeDescriptor::get_invariants(): the order is higher than the order of the descriptor.");
+        }
+
+        return T1D(invariants_.begin(), invariants_.begin() + InvariantCount(_order));
+    }
+
+    /// Number of the invariants of a descriptor of the given order, one per (n, l) with even n - l
+    static size_t InvariantCount(size_t _order)
+    {
+        return (_order / 2 + 1) * (_order - _order / 2 + 1);
+    }
+
+    /// The geometrical moments up to the order of the descriptor, see GeometricalMomentIndex()
+    const T1D & GetGeometricalMoments() const
+    {
+        return gm_.GetMoments();
+    }
+
+    Normalization GetNormalization() const
+    {
+        return Normalization{ xDim_, yDim_, zDim_, zeroMoment_, xCOG_, yCOG_, zCOG_, scale_ };
+    }
+
 private:
+    /// Descriptor without moments, see ComputeLanes()
+    ZernikeDescriptor(size_t _order, size_t _dim) : order_(_order), xDim_(_dim), yDim_(_dim), zDim_(_dim)
+    {
+    }
+
+    bool IsCubic() const
+    {
+        return xDim_ == yDim_ && xDim_ == zDim_;
+    }
+
     // ---- private helper functions ----
     /**
  * Cuts off the function : the object is mapped into the unit ball according to
  * the precomputed center of gravity and scaling factor. All the voxels remaining
- * outside the unit ball are set to zero.
+ * outside the unit ball are set to zero. Only the voxels of _box are visited,
+ * the others are zero. With _pool the z-slabs are processed in parallel, see
+ * SlabsPerItem(). The items are whole slabs of the grid, not of the box, so
+ * they start at multiples of 64 voxels and never write the same word of a
+ * std::vector<bool>, their slabs are clipped to the box.
  */
-    void NormalizeGrid(InputVoxelIterator voxels)
+    void NormalizeGrid(InputVoxelIterator voxels, const VoxelBox & _box, ThreadPool * _pool)
     {
-        T point[3];
-
         // it is easier to work with squared radius -> no sqrt required
         T radius = static_cast<T>(1) / scale_;
         T sqrRadius = radius * radius;
 
-        for (size_t x = 0; x < dim_; ++x)
+        const size_t xBegin = _box.x_, xEnd = xBegin + _box.xSize_;
+        const size_t yBegin = _box.y_, yEnd = yBegin + _box.ySize_;
+        const size_t zBegin = _box.z_, zEnd = zBegin + _box.zSize_;
+
+        const size_t slabsPerItem = SlabsPerItem(static_cast<int>(zDim_), xDim_ * yDim_);
+        const size_t firstItem = zBegin / slabsPerItem;
+        const size_t itemEnd = (zEnd + slabsPerItem - 1) / slabsPerItem;
+
+        ParallelFor(_pool, itemEnd - firstItem, [&](size_t _item)
         {
-            for (size_t y = 0; y < dim_; ++y)
+            T point[3];
+
+            const size_t itemBegin = (firstItem + _item) * slabsPerItem;
+
+            for (size_t z = std::max(itemBegin, zBegin); z < std::min(itemBegin + slabsPerItem, zEnd); ++z)
             {
-                for (size_t z = 0; z < dim_; ++z)
+                for (size_t y = yBegin; y < yEnd; ++y)
                 {
-                    size_t index{ (z * dim_ + y) * dim_ + x };
-
-                    if (voxels[index] != static_cast<VoxelType>(0))
+                    for (size_t x = xBegin; x < xEnd; ++x)
                     {
-                        point[0] = static_cast<T>(x) - xCOG_;
-                        point[1] = static_cast<T>(y) - yCOG_;
-                        point[2] = static_cast<T>(z) - zCOG_;
-
-                        T sqrLen = point[0] * point[0] + point[1] * point[1] + point[2] * point[2];
+                        size_t index{ (z * yDim_ + y) * xDim_ + x };
 
-                        if (sqrLen > sqrRadius)
+                        if (voxels[index] != static_cast<VoxelType>(0))
                         {
-                            voxels[index] = static_cast<VoxelType>(0);
+                            point[0] = static_cast<T>(x) - xCOG_;
+                            point[1] = static_cast<T>(y) - yCOG_;
+                            point[2] = static_cast<T>(z) - zCOG_;
+
+                            T sqrLen = point[0] * point[0] + point[1] * point[1] + point[2] * point[2];
+
+                            if (sqrLen > sqrRadius)
+                            {
+                                voxels[index] = static_cast<VoxelType>(0);
+                            }
                         }
                     }
                 }
             }
+        });
+    }
+
+    /// Takes a normalization of GetNormalization(), it has to belong to a grid of the same dimensions
+    void SetNormalization(const Normalization & _normalization)
+    {
+        if (_normalization.xDim_ != xDim_ || _normalization.yDim_ != yDim_ || _normalization.zDim_ != zDim_)
+        {
+            throw std::invalid_argument("ZernikeDescriptor: the normalization belongs to a grid of other dimensions.");
         }
+
+        zeroMoment_ = _normalization.zeroMoment_;
+        xCOG_ = _normalization.xCOG_;
+        yCOG_ = _normalization.yCOG_;
+        zCOG_ = _normalization.zCOG_;
+        scale_ = _normalization.scale_;
     }
 
     /**
  * Center of gravity and a scaling factor is computed according to the geometrical
  * moments and a bounding sphere around the cog.
  */
-    void ComputeNormalization(InputVoxelIterator voxels)
+    void ComputeNormalization(InputVoxelIterator voxels, const VoxelBox & _box, ThreadPool * _pool, bool _occupancy = false)
     {
         static_assert(std::is_floating_point<T>::value, "T must be float, double or long double");
-        ScaledGeometricalMoments<InputVoxelIterator, T> gm(voxels, dim_, dim_, dim_, 0.0, 0.0, 0.0, 1.0);
+        ScaledGeometricalMoments<InputVoxelIterator, T> gm;
+        gm.Init(voxels, xDim_, yDim_, zDim_, _box, 0.0, 0.0, 0.0, 1.0, 1, GeometricalMomentsEngine::diff, _pool);
 
         // compute the geometrical transform for no translation and scaling, first
         // to get the 0'th and 1'st order properties of the function
@@ -217,7 +728,7 @@ private:
         // scaling, so that the function gets mapped into the unit sphere
 
         //T recScale = ComputeScale_BoundingSphere (voxels_, dim_, xCOG_, yCOG_, zCOG_);
-        T recScale = 2.0 * ComputeScale_RadiusVar(voxels, dim_, xCOG_, yCOG_, zCOG_);
+        T recScale = 2.0 * ComputeScale_RadiusVar(voxels, xDim_, yDim_, _box, xCOG_, yCOG_, zCOG_, _pool, _occupancy);
 
         if (recScale == 0.0)
         {
@@ -226,13 +737,585 @@ private:
         scale_ = static_cast<T>(1) / recScale;
     }
 
-    void ComputeMoments(InputVoxelIterator voxels)
+    void ComputeMoments(InputVoxelIterator voxels, const VoxelBox & _box, bool _computeZernike, GeometricalMomentsEngine _engine, ThreadPool * _pool)
     {
-        gm_.Init(voxels, dim_, dim_, dim_, xCOG_, yCOG_, zCOG_, scale_, order_);
+        gm_.Init(voxels, xDim_, yDim_, zDim_, _box, xCOG_, yCOG_, zCOG_, scale_, order_, _engine, _pool);
+
+        if (_computeZernike)
+        {
+            ComputeZernikeMoments();
+        }
+    }
 
-        // Zernike moments
-        zm_.Init(order_, gm_);
-        zm_.Compute();
+    /// Zernike moments, the basis is shared between all descriptors of the same order
+    void ComputeZernikeMoments()
+    {
+        zm_.Init(order_);
+        zm_.Compute(gm_);
+    }
+
+    /**
+ * The same as NormalizeGrid() for a segment grid: returns the segments clipped
+ * to the unit ball. The voxels of a line inside the ball form an interval,
+ * its ends are found with the same test as in the dense version.
+ */
+    VoxelSegments NormalizeGrid(const VoxelSegments & _segments) const
+    {
+        T radius = static_cast<T>(1) / scale_;
+        T sqrRadius = radius * radius;
+
+        VoxelSegments clipped(_segments.GetDim());
+
+        int lineX = -1, lineZ = -1, yLow = 0, yHigh = 0;   // [yLow, yHigh) is inside the ball
+
+        for (const auto & segment : _segments.GetSegments())
+        {
+            if (segment.x_ != lineX || segment.z_ != lineZ)
+            {
+                lineX = segment.x_;
+                lineZ = segment.z_;
+
+                T dx = static_cast<T>(lineX) - xCOG_;
+                T dz = static_cast<T>(lineZ) - zCOG_;
+
+                auto inside = [&](int _y)
+                {
+                    T dy = static_cast<T>(_y) - yCOG_;
+                    return dx * dx + dy * dy + dz * dz <= sqrRadius;
+                };
+
+                T halfChord = std::sqrt(std::max(sqrRadius - dx * dx - dz * dz, static_cast<T>(0)));
+
+                FindBallInterval(inside, yCOG_, halfChord, yLow, yHigh);
+            }
+
+            int yBegin = std::max(segment.yBegin_, yLow);
+            int yEnd = std::min(segment.yEnd_, yHigh);
+
+            if (yBegin < yEnd)
+            {
+                clipped.Add(segment.x_, segment.z_, yBegin, yEnd);
+            }
+        }
+
+        return clipped;
+    }
+
+    /**
+ * [_low, _high): the positions t of a line with inside(t) around _center. The
+ * interval is estimated with _halfChord and corrected with _inside, so the
+ * result does not depend on the rounding of sqrt.
+ */
+    template<class Inside>
+    static void FindBallInterval(Inside && _inside, T _center, T _halfChord, int & _low, int & _high)
+    {
+        _low = static_cast<int>(std::ceil(_center - _halfChord));
+        _high = static_cast<int>(std::floor(_center + _halfChord)) + 1;
+
+        while (_low < _high && !_inside(_low))
+        {
+            ++_low;
+        }
+
+        while (_low < _high && !_inside(_high - 1))
+        {
+            --_high;
+        }
+
+        if (_low < _high)
+        {
+            while (_inside(_low - 1))
+            {
+                --_low;
+            }
+
+            while (_inside(_high))
+            {
+                ++_high;
+            }
+        }
+    }
+
+    /**
+ * The same as NormalizeGrid() for a bit-packed grid: the voxels of a line
+ * inside the ball form an interval, the rest of the line is cleared with masks.
+ */
+    void NormalizeGrid(BitVoxelGrid & _grid) const
+    {
+        T radius = static_cast<T>(1) / scale_;
+        T sqrRadius = radius * radius;
+
+        for (int z = 0; z < _grid.GetDim(); ++z)
+        {
+            for (int y = 0; y < _grid.GetDim(); ++y)
+            {
+                std::size_t line = static_cast<std::size_t>(z) * _grid.GetDim() + y;
+
+                if (_grid.CountVoxels(line) == 0)
+                {
+                    continue;
+                }
+
+                T dy = static_cast<T>(y) - yCOG_;
+                T dz = static_cast<T>(z) - zCOG_;
+
+                auto inside = [&](int _x)
+                {
+                    T dx = static_cast<T>(_x) - xCOG_;
+                    return dx * dx + dy * dy + dz * dz <= sqrRadius;
+                };
+
+                T halfChord = std::sqrt(std::max(sqrRadius - dy * dy - dz * dz, static_cast<T>(0)));
+                int xLow, xHigh;
+
+                FindBallInterval(inside, xCOG_, halfChord, xLow, xHigh);
+                _grid.ClipLine(line, xLow, xHigh);
+            }
+        }
+    }
+
+    /**
+ * The same as NormalizeGrid() for a brick grid. A brick whose voxels are all
+ * inside the ball is kept and one whose voxels are all outside is cleared, with
+ * the same test at the farthest and the nearest voxel of the brick; the test is
+ * monotonic in the distances along the axes. The lines of the other bricks are
+ * clipped to their intervals inside the ball.
+ */
+    void NormalizeGrid(BrickVoxelGrid & _grid) const
+    {
+        const int brickDim = BrickVoxelGrid::brickDim;
+
+        T radius = static_cast<T>(1) / scale_;
+        T sqrRadius = radius * radius;
+
+        auto sqrDistance = [](T _dx, T _dy, T _dz)
+        {
+            return _dx * _dx + _dy * _dy + _dz * _dz;
+        };
+
+        // the nearest and the farthest distance of the voxels [_begin, _end) from _center
+        auto axisRange = [](int _begin, int _end, T _center, T & _near, T & _far)
+        {
+            T first = static_cast<T>(_begin) - _center;
+            T last = static_cast<T>(_end - 1) - _center;
+            int nearest = std::min(std::max(static_cast<int>(std::lround(_center)), _begin), _end - 1);
+
+            _near = static_cast<T>(nearest) - _center;
+            _far = std::abs(first) > std::abs(last) ? first : last;
+        };
+
+        for (std::size_t brick = 0; brick < _grid.GetBrickCount(); ++brick)
+        {
+            if (_grid.IsEmpty(brick))
+            {
+                continue;
+            }
+
+            int x0, y0, z0;
+            _grid.GetBrickOrigin(brick, x0, y0, z0);
+
+            int x1 = std::min(x0 + brickDim, _grid.GetDim());
+            int y1 = std::min(y0 + brickDim, _grid.GetDim());
+            int z1 = std::min(z0 + brickDim, _grid.GetDim());
+
+            T xNear, xFar, yNear, yFar, zNear, zFar;
+            axisRange(x0, x1, xCOG_, xNear, xFar);
+            axisRange(y0, y1, yCOG_, yNear, yFar);
+            axisRange(z0, z1, zCOG_, zNear, zFar);
+
+            if (sqrDistance(xFar, yFar, zFar) <= sqrRadius)
+            {
+                continue;
+            }
+
+            if (sqrDistance(xNear, yNear, zNear) > sqrRadius)
+            {
+                _grid.Clear(brick);
+                continue;
+            }
+
+            for (int x = x0; x < x1; ++x)
+            {
+                for (int z = z0; z < z1; ++z)
+                {
+                    T dx = static_cast<T>(x) - xCOG_;
+                    T dz = static_cast<T>(z) - zCOG_;
+
+                    auto inside = [&](int _y)
+                    {
+                        T dy = static_cast<T>(_y) - yCOG_;
+                        return dx * dx + dy * dy + dz * dz <= sqrRadius;
+                    };
+
+                    T halfChord = std::sqrt(std::max(sqrRadius - dx * dx - dz * dz, static_cast<T>(0)));
+                    int yLow, yHigh;
+
+                    FindBallInterval(inside, yCOG_, halfChord, yLow, yHigh);
+                    _grid.ClipLine(brick, x - x0, z - z0, yLow - y0, yHigh - y0);
+                }
+            }
+        }
+    }
+
+    /// Adds _weight times the moments of the segments with the current normalization
+    void AddSegmentMoments(const VoxelSegments & _segments, T _weight)
+    {
+        if (_segments.GetVoxelCount() == 0)
+        {
+            return;
+        }
+
+        ScaledGeometricalMomentsT gm;
+        gm.InitFromSegments(_segments, xCOG_, yCOG_, zCOG_, scale_, static_cast<int>(order_));
+
+        gm_.Add(gm.GetMoments(), _weight);
+    }
+
+    /**
+ * Moments of the voxels of the edited grid which are inside only one of the
+ * unit balls of _old and of the current normalization: the ones inside the new
+ * ball are added, the others subtracted. The lines along y are clipped with the
+ * same test as in NormalizeGrid(), so only the voxels of the shell are read.
+ */
+    void AddBallShell(InputVoxelIterator _voxels, const Normalization & _old)
+    {
+        struct Ball
+        {
+            T xCOG_, yCOG_, zCOG_, sqrRadius_;
+
+            void FindInterval(int _x, int _z, int & _low, int & _high) const
+            {
+                T dx = static_cast<T>(_x) - xCOG_;
+                T dz = static_cast<T>(_z) - zCOG_;
+
+                auto inside = [&](int _y)
+                {
+                    T dy = static_cast<T>(_y) - yCOG_;
+                    return dx * dx + dy * dy + dz * dz <= sqrRadius_;
+                };
+
+                T halfChord = std::sqrt(std::max(sqrRadius_ - dx * dx - dz * dz, static_cast<T>(0)));
+
+                FindBallInterval(inside, yCOG_, halfChord, _low, _high);
+            }
+        };
+
+        T oldRadius = static_cast<T>(1) / _old.scale_;
+        T newRadius = static_cast<T>(1) / scale_;
+
+        const Ball oldBall{ _old.xCOG_, _old.yCOG_, _old.zCOG_, oldRadius * oldRadius };
+        const Ball newBall{ xCOG_, yCOG_, zCOG_, newRadius * newRadius };
+
+        // the edit and so the grid are cubic
+        const int dim = static_cast<int>(xDim_);
+
+        VoxelSegments entered(dim), left(dim);
+
+        // adds the runs of set voxels of the line (_x, _z) with y in [_begin, _end)
+        auto addRuns = [&](VoxelSegments & _segments, int _x, int _z, int _begin, int _end)
+        {
+            _begin = std::max(_begin, 0);
+            _end = std::min(_end, dim);
+
+            int runBegin = _begin;
+
+            for (int y = _begin; y <= _end; ++y)
+            {
+                bool isSet = y < _end && _voxels[(static_cast<size_t>(_z) * dim + y) * dim + _x] != static_cast<VoxelType>(0);
+
+                if (!isSet)
+                {
+                    _segments.Add(_x, _z, runBegin, std::max(runBegin, y));
+                    runBegin = y + 1;
+                }
+            }
+        };
+
+        for (int x = 0; x < dim; ++x)
+        {
+            for (int z = 0; z < dim; ++z)
+            {
+                int oldLow, oldHigh, newLow, newHigh;
+
+                oldBall.FindInterval(x, z, oldLow, oldHigh);
+                newBall.FindInterval(x, z, newLow, newHigh);
+
+                // [newLow, newHigh) without [oldLow, oldHigh) and vice versa, the intervals may be empty
+                addRuns(entered, x, z, newLow, std::min(newHigh, oldLow));
+                addRuns(entered, x, z, std::max(newLow, oldHigh), newHigh);
+                addRuns(left, x, z, oldLow, std::min(oldHigh, newLow));
+                addRuns(left, x, z, std::max(oldLow, newHigh), oldHigh);
+            }
+        }
+
+        AddSegmentMoments(entered, static_cast<T>(1));
+        AddSegmentMoments(left, static_cast<T>(-1));
+    }
+
+    /**
+ * Exact sums over the set voxels of a binary grid: the count and the sums of
+ * the coordinates and of their squares, see ComputeNormalization(const VoxelSums &).
+ */
+    struct VoxelSums
+    {
+        std::uint64_t count_{ 0 };
+        std::uint64_t sums_[3]{};
+        std::uint64_t sqrSums_[3]{};
+
+        /// sum of t over [0, _end)
+        static std::uint64_t SumTo(std::uint64_t _end)
+        {
+            return _end == 0 ? 0 : _end * (_end - 1) / 2;
+        }
+
+        /// sum of t^2 over [0, _end)
+        static std::uint64_t SqrSumTo(std::uint64_t _end)
+        {
+            return _end == 0 ? 0 : (_end - 1) * _end * (2 * _end - 1) / 6;
+        }
+
+        /// Adds _count voxels with the coordinate _value along _axis
+        void AddConstant(int _axis, std::uint64_t _value, std::uint64_t _count)
+        {
+            sums_[_axis] += _count * _value;
+            sqrSums_[_axis] += _count * _value * _value;
+        }
+
+        /// Adds the coordinates [_begin, _end) along _axis
+        void AddRange(int _axis, std::uint64_t _begin, std::uint64_t _end)
+        {
+            sums_[_axis] += SumTo(_end) - SumTo(_begin);
+            sqrSums_[_axis] += SqrSumTo(_end) - SqrSumTo(_begin);
+        }
+
+        /// Adds the voxels of a dense cubic grid, a voxel is set if it is not zero
+        void Add(InputVoxelIterator _voxels, int _dim)
+        {
+            for (std::uint64_t z = 0; z < static_cast<std::uint64_t>(_dim); ++z)
+            {
+                for (std::uint64_t y = 0; y < static_cast<std::uint64_t>(_dim); ++y)
+                {
+                    std::uint64_t lineCount{ 0 };
+
+                    for (std::uint64_t x = 0; x < static_cast<std::uint64_t>(_dim); ++x, ++_voxels)
+                    {
+                        if (*_voxels != static_cast<VoxelType>(0))
+                        {
+                            ++lineCount;
+                            sums_[0] += x;
+                            sqrSums_[0] += x * x;
+                        }
+                    }
+
+                    count_ += lineCount;
+                    AddConstant(1, y, lineCount);
+                    AddConstant(2, z, lineCount);
+                }
+            }
+        }
+
+        /// Adds the voxels of a brick grid, the sums of a full brick are closed forms
+        void Add(const BrickVoxelGrid & _grid)
+        {
+            const std::uint64_t brickDim = BrickVoxelGrid::brickDim;
+
+            for (std::size_t brick = 0; brick < _grid.GetBrickCount(); ++brick)
+            {
+                const BrickVoxelGrid::Word * mask = _grid.GetMask(brick);
+
+                int x0, y0, z0;
+                _grid.GetBrickOrigin(brick, x0, y0, z0);
+
+                if (_grid.IsFull(brick))
+                {
+                    const std::uint64_t origin[3] = { static_cast<std::uint64_t>(x0), static_cast<std::uint64_t>(y0), static_cast<std::uint64_t>(z0) };
+
+                    count_ += brickDim * brickDim * brickDim;
+
+                    for (int axis = 0; axis < 3; ++axis)
+                    {
+                        sums_[axis] += (SumTo(origin[axis] + brickDim) - SumTo(origin[axis])) * brickDim * brickDim;
+                        sqrSums_[axis] += (SqrSumTo(origin[axis] + brickDim) - SqrSumTo(origin[axis])) * brickDim * brickDim;
+                    }
+                }
+                else if (mask != nullptr)
+                {
+                    for (int x = 0; x < BrickVoxelGrid::brickDim; ++x)
+                    {
+                        for (int z = 0; z < BrickVoxelGrid::brickDim; ++z)
+                        {
+                            BrickVoxelGrid::ForEachRun(mask, x, z, [&](int _yBegin, int _yEnd)
+                            {
+                                std::uint64_t length = _yEnd - _yBegin;
+
+                                count_ += length;
+                                AddConstant(0, x0 + x, length);
+                                AddRange(1, y0 + _yBegin, y0 + _yEnd);
+                                AddConstant(2, z0 + z, length);
+                            });
+                        }
+                    }
+                }
+            }
+        }
+
+        /// Adds the voxels of segments along y
+        void Add(const VoxelSegments & _segments)
+        {
+            for (const auto & segment : _segments.GetSegments())
+            {
+                std::uint64_t length = segment.yEnd_ - segment.yBegin_;
+
+                count_ += length;
+                AddConstant(0, segment.x_, length);
+                AddRange(1, segment.yBegin_, segment.yEnd_);
+                AddConstant(2, segment.z_, length);
+            }
+        }
+    };
+
+    /**
+ * The same as the dense ComputeNormalization() for a bit-packed grid. The
+ * counts and the sums of the coordinates and their squares are exact integers:
+ * popcount per line for the counts and closed forms over the runs along x.
+ */
+    void ComputeNormalization(const BitVoxelGrid & _grid)
+    {
+        VoxelSums sums;
+
+        for (std::uint64_t z = 0; z < static_cast<std::uint64_t>(_grid.GetDim()); ++z)
+        {
+            for (std::uint64_t y = 0; y < static_cast<std::uint64_t>(_grid.GetDim()); ++y)
+            {
+                std::size_t line = z * _grid.GetDim() + y;
+                std::uint64_t lineCount = _grid.CountVoxels(line);
+
+                if (lineCount == 0)
+                {
+                    continue;
+                }
+
+                sums.count_ += lineCount;
+                sums.AddConstant(1, y, lineCount);
+                sums.AddConstant(2, z, lineCount);
+
+                _grid.ForEachRun(line, [&sums](int _begin, int _end)
+                {
+                    sums.AddRange(0, _begin, _end);
+                });
+            }
+        }
+
+        ComputeNormalization(sums);
+    }
+
+    /// The same as the dense ComputeNormalization() for a segment grid, see ComputeNormalization(const VoxelSums &)
+    void ComputeNormalization(const VoxelSegments & _segments)
+    {
+        VoxelSums sums;
+        sums.Add(_segments);
+
+        ComputeNormalization(sums);
+    }
+
+    /**
+ * The center of gravity and the scaling factor from the exact sums over the
+ * voxels, the same as the dense ComputeNormalization() up to rounding.
+ */
+    void ComputeNormalization(const VoxelSums & _sums)
+    {
+        static_assert(std::is_floating_point<T>::value, "T must be float, double or long double");
+
+        if (_sums.count_ == 0)
+        {
+            throw std::runtime_error("No voxels in grid!");
+        }
+
+        T n = static_cast<T>(_sums.count_);
+
+        // the moments are integrals over the voxel cubes, the center of a voxel is (x + 0.5, ...)
+        zeroMoment_ = n;
+        xCOG_ = static_cast<T>(_sums.sums_[0]) / n + static_cast<T>(0.5);
+        yCOG_ = static_cast<T>(_sums.sums_[1]) / n + static_cast<T>(0.5);
+        zCOG_ = static_cast<T>(_sums.sums_[2]) / n + static_cast<T>(0.5);
+
+        // Average squared distance from the COG with y and z swapped as in ComputeScale_RadiusVar():
+        // sum of (x - xCOG)^2 = sum x^2 - 2 xCOG sum x + n xCOG^2, (z - yCOG)^2 and (y - zCOG)^2 alike
+        auto sqrDistanceSum = [n, &_sums](int _axis, T _center)
+        {
+            return static_cast<T>(_sums.sqrSums_[_axis]) - 2 * _center * static_cast<T>(_sums.sums_[_axis]) + n * _center * _center;
+        };
+
+        T sum = sqrDistanceSum(0, xCOG_) + sqrDistanceSum(2, yCOG_) + sqrDistanceSum(1, zCOG_);
+        T recScale = 2.0 * std::sqrt(sum / n);
+
+        if (recScale == 0.0)
+        {
+            throw std::runtime_error("No voxels in grid!");
+        }
+        scale_ = static_cast<T>(1) / recScale;
+    }
+
+    /**
+ * The normalization of an edited grid from the current one and the exact sums
+ * over the set and the cleared voxels, see ComputeNormalization(const VoxelSums &).
+ * The sums over the original grid are recovered from the center of gravity and
+ * the scale: sum x = n (xCOG - 0.5) and the sum of the squared distances is
+ * n / (2 scale)^2. The arithmetic is done in double.
+ */
+    void UpdateNormalization(const VoxelSums & _set, const VoxelSums & _cleared)
+    {
+        double n = zeroMoment_;
+        double cogs[3] = { xCOG_, yCOG_, zCOG_ };
+        double sums[3];
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            sums[axis] = n * (cogs[axis] - 0.5);
+        }
+
+        // y and z are swapped in the squared distances as in ComputeScale_RadiusVar()
+        auto crossSum = [&]()
+        {
+            return cogs[0] * sums[0] + cogs[1] * sums[2] + cogs[2] * sums[1];
+        };
+
+        auto sqrCogs = [&]()
+        {
+            return cogs[0] * cogs[0] + cogs[1] * cogs[1] + cogs[2] * cogs[2];
+        };
+
+        double radius = 0.5 / static_cast<double>(scale_);
+        double sqrSum = n * radius * radius + 2.0 * crossSum() - n * sqrCogs();     // sum x^2 + y^2 + z^2
+
+        n += static_cast<double>(_set.count_) - static_cast<double>(_cleared.count_);
+
+        if (n <= 0.0)
+        {
+            throw std::runtime_error("No voxels in grid!");
+        }
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            sums[axis] += static_cast<double>(_set.sums_[axis]) - static_cast<double>(_cleared.sums_[axis]);
+            sqrSum += static_cast<double>(_set.sqrSums_[axis]) - static_cast<double>(_cleared.sqrSums_[axis]);
+            cogs[axis] = sums[axis] / n + 0.5;
+        }
+
+        double sqrDistanceSum = sqrSum - 2.0 * crossSum() + n * sqrCogs();
+
+        zeroMoment_ = static_cast<T>(n);
+        xCOG_ = static_cast<T>(cogs[0]);
+        yCOG_ = static_cast<T>(cogs[1]);
+        zCOG_ = static_cast<T>(cogs[2]);
+
+        T recScale = static_cast<T>(2.0 * std::sqrt(std::max(sqrDistanceSum, 0.0) / n));
+
+        if (recScale == 0.0)
+        {
+            throw std::runtime_error("No voxels in grid!");
+        }
+        scale_ = static_cast<T>(1) / recScale;
     }
 
     /**
@@ -311,44 +1394,89 @@ private:
     /**
  * Computes the average distance from the given COG to all voxels with value bigger than 0.9
  * I.e. I think a binary volume is implicitly assumed here.
+ * With _occupancy every voxel is weighted by its value instead, for grids of
+ * fractional occupancy, see VoxelPyramid.
+ * The voxel (x, z, y) is taken as the point (x, y, z), see ComputeNormalization(const VoxelSegments &).
+ * The partial sums of the z-slabs are added in a fixed order, so the result does
+ * not depend on the number of threads of _pool.
  */
     double ComputeScale_RadiusVar(
         InputVoxelIterator _voxels,
-        int _dim,
+        size_t _xDim,
+        size_t _yDim,
+        const VoxelBox & _box,      // the voxels outside the box are zero
         T _xCOG,
         T _yCOG,
-        T _zCOG
+        T _zCOG,
+        ThreadPool * _pool = nullptr,
+        bool _occupancy = false
     )
     {
-        // the edge length of the voxel grid in voxel units
-        int d = _dim;
+        const size_t xBegin = _box.x_, xEnd = xBegin + _box.xSize_;
+        const size_t yBegin = _box.y_, yEnd = yBegin + _box.ySize_;
+        const size_t zBegin = _box.z_, zEnd = zBegin + _box.zSize_;
 
-        size_t nVoxels{ 0 };
+        const size_t slabsPerItem = SlabsPerItem(_box.zSize_, static_cast<size_t>(_box.xSize_) * _box.ySize_);
+        const size_t itemCount = (_box.zSize_ + slabsPerItem - 1) / slabsPerItem;
 
-        T sum{ 0.0 };
+        vector<size_t> nVoxels(itemCount, 0);
+        T1D weights(itemCount, 0.0);
+        T1D sums(itemCount, 0.0);
 
-        for (size_t x = 0; x < d; ++x)
+        ParallelFor(_pool, itemCount, [&](size_t _item)
         {
-            for (size_t y = 0; y < d; ++y)
+            MomentSum<T> itemSum;
+            size_t itemVoxels{ 0 };
+            T itemWeight{ 0.0 };
+
+            // z and y are the slab and the line of the voxel in memory
+            for (size_t z = zBegin + _item * slabsPerItem; z < std::min(zBegin + (_item + 1) * slabsPerItem, zEnd); ++z)
             {
-                for (size_t z = 0; z < d; ++z)
+                for (size_t y = yBegin; y < yEnd; ++y)
                 {
-                    if (static_cast<double>(_voxels[(z + d * y) * d + x]) > 0.9)
+                    for (size_t x = xBegin; x < xEnd; ++x)
                     {
-                        T mx = static_cast<T>(x) - _xCOG;
-                        T my = static_cast<T>(y) - _yCOG;
-                        T mz = static_cast<T>(z) - _zCOG;
-                        T temp = mx * mx + my * my + mz * mz;
+                        double value = static_cast<double>(_voxels[(z * _yDim + y) * _xDim + x]);
 
-                        sum += temp;
+                        if (_occupancy ? value > 0.0 : value > 0.9)
+                        {
+                            T mx = static_cast<T>(x) - _xCOG;
+                            T my = static_cast<T>(z) - _yCOG;
+                            T mz = static_cast<T>(y) - _zCOG;
+                            T temp = mx * mx + my * my + mz * mz;
+
+                            if (_occupancy)
+                            {
+                                itemSum.Add(static_cast<T>(value) * temp);
+                                itemWeight += static_cast<T>(value);
+                            }
+                            else
+                            {
+                                itemSum.Add(temp);
+                            }
 
-                        nVoxels++;
+                            itemVoxels++;
+                        }
                     }
                 }
             }
+
+            sums[_item] = itemSum.Get();
+            nVoxels[_item] = itemVoxels;
+            weights[_item] = itemWeight;
+        });
+
+        T sum{ 0.0 }, weight{ 0.0 };
+        size_t count{ 0 };
+
+        for (size_t item = 0; item < itemCount; ++item)
+        {
+            sum += sums[item];
+            count += nVoxels[item];
+            weight += weights[item];
         }
 
-        T retval = sqrt(sum / nVoxels);
+        T retval = _occupancy ? sqrt(sum / weight) : sqrt(sum / count);
 
         return retval;
     }
@@ -356,7 +1484,7 @@ private:
 private:
     // ---- member variables ----
     size_t     order_;                 // maximal order of the moments to be computed (max{n})
-    size_t     dim_;                   // length of the edge of the voxel grid (which is a cube)
+    size_t     xDim_, yDim_, zDim_;    // edges of the voxel grid, equal for the cubic grids
 
     T       zeroMoment_,            // zero order moment
         xCOG_, yCOG_, zCOG_,    // center of gravity
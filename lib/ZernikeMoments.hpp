@@ -41,40 +41,18 @@ for more information, see the paper:
 
 #pragma once
 
-// ----- local program includes -----
-#include "ScaledGeometricMoments.hpp"
-
-/**
- * Struct representing a complex coefficient of a moment
- * of order (p_,q_,r_)
- */
-template<class T>
-struct ComplexCoeff
-{
-    typedef     std::complex<T>     ValueT;
-
-    /**
- * Constructor with scalar args
- */
-    ComplexCoeff(int _p, int _q, int _r, const ValueT & _value) :
-        p_(_p), q_(_q), r_(_r), value_(_value)
-    {
-    }
+// ---- std includes ---
+#include <algorithm>
+#include <complex>
+#include <memory>
+#include <stdexcept>
+#include <vector>
 
-    /**
- * Copy constructor
- */
-    ComplexCoeff(const ComplexCoeff<T> & _cc) : p_(_cc.p_), q_(_cc.q_), r_(_cc.r_), value_(_cc.value_)
-    {
-    }
-
-    ComplexCoeff() : p_(0), q_(0), r_(0)
-    {
-    }
+#include <boost/math/constants/constants.hpp>
 
-    int                 p_, q_, r_;
-    ValueT     value_;
-};
+// ----- local program includes -----
+#include "ScaledGeometricMoments.hpp"
+#include "ZernikeBasis.hpp"
 
 /**
  * Class representing the Zernike moments
@@ -91,16 +69,28 @@ public:
     typedef vector<T3D>         T4D;        // 3D array of scalar type
 
     typedef std::complex<T>                      ComplexT;       // complex type
+    typedef vector<ComplexT>                     ComplexT1D;     // vector of complex type
     typedef vector<vector<vector<ComplexT> > >   ComplexT3D;     // 3D array of complex type
 
-    typedef ComplexCoeff<T>                      ComplexCoeffT;
-    typedef vector<vector<vector<vector<ComplexCoeffT> > > >    ComplexCoeffT4D;
+    typedef ZernikeBasis<T>                      BasisT;
+
+    /**
+ * Complex coefficient of the geometrical moment of order (p_,q_,r_),
+ * used by the debug functions
+ */
+    struct ComplexCoeffT
+    {
+        int         p_, q_, r_;
+        ComplexT    value_;
+    };
+
+    typedef ScaledGeometricalMoments<InputVoxelIterator, MomentT>   ScaledGeometricalMomentsT;
 
 public:
     // ---- public member functions ----
-    ZernikeMoments(int _order, ScaledGeometricalMoments<InputVoxelIterator, MomentT> & _gm)
+    explicit ZernikeMoments(int _order)
     {
-        Init(_order, _gm);
+        Init(_order);
     }
 
     ZernikeMoments() :
@@ -108,89 +98,148 @@ public:
     {
     }
 
-    /* Todo: Init() doesn't depend on the geomentrical moments.
-     * Removing the  parameter and moving it to Compute() will make the class more efficient to reuse to
-     * compute ZM for several objects at once.
+    /**
+ * Attaches the shared input data independent coefficients of the given order.
+ * The basis is built only once per process, see ZernikeBasis::Get().
+ */
+    void Init(int _order)
+    {
+        Init(BasisT::Get(_order));
+    }
 
-     * Computes all coefficients that are input data independent
-     */
-    void Init(int _order, ScaledGeometricalMoments<InputVoxelIterator, MomentT> & _gm)
+    void Init(std::shared_ptr<const BasisT> _basis)
     {
-        static_assert(std::is_floating_point<T>::value, "MomentT must be float, double or long double");
-        /* Todo: Init() doesn't depend on the geomentrical moments.
-         * Removing the  parameter and moving it to Compute() will make the class more efficient to reuse to
-         * compute ZM for several objects at once.
-         */
-        gm_ = _gm;
-        order_ = _order;
-
-        ComputeCs();
-        ComputeQs();
-        ComputeGCoefficients();
+        basis_ = std::move(_basis);
+        order_ = basis_->GetOrder();
     }
 
     /**
  * Computes the Zernike moments. This computation is data dependent
  * and has to be performed for each new object and/or transformation.
  */
-    void Compute()
+    void Compute(const ScaledGeometricalMomentsT & _gm)
     {
-        // geometrical moments have to be computed first
-        if (!order_)
+        // the basis has to be attached first
+        if (!basis_)
+        {
+            throw std::runtime_error("ZernikeMoments<InputVoxelIterator,MomentT>::Compute(): attempting to \
+                     compute Zernike moments without initializing the basis first.");
+        }
+
+        if (_gm.GetMaxOrder() < order_)
         {
-            throw std::runtime_error("ZernikeMoments<InputVoxelIterator,MomentT>::ComputeZernikeMoments (): attempting to \
-                     compute Zernike moments without setting valid geometrical \
-                     moments first.");
+            throw std::invalid_argument("ZernikeMoments<InputVoxelIterator,MomentT>::Compute(): the order of the \
+                     geometrical moments is lower than the order of the Zernike moments.");
         }
 
         /*
-         indexing:
-           n goes 0..order_
-           l goes 0..n so that n-l is even
-           m goes -l..l
+         One row of the basis per [n,l,m] with m >= 0 (see ZernikeBasis::GetRowIndex()),
+         the Zernike moments are the product of the sparse basis and the dense
+         vector of the geometrical moments. The moments are real and every
+         coefficient is either purely real or purely imaginary, so the real and
+         the imaginary part are two real sums over the according tables.
         */
 
-        T nullMoment;
-
         constexpr T three_quarters_div_pi = boost::math::constants::three_quarters<T>() * 1 / boost::math::constants::pi<T>();
 
-        zernikeMoments_.resize(order_ + 1);
-        for (int n = 0; n <= order_; ++n)
+        const std::size_t rowCount = basis_->GetRowCount();
+        const typename BasisT::Table & reTable = basis_->GetRealTable();
+        const typename BasisT::Table & imTable = basis_->GetImagTable();
+        const T * moments = _gm.GetMoments().data();
+
+        zernikeMoments_.resize(rowCount);
+
+        for (std::size_t row = 0; row < rowCount; ++row)
         {
-            zernikeMoments_[n].resize(n / 2 + 1);
+            // Zernike moment of according indices [nlm], conj(c) * moment
+            MomentSum<T> re, im;
 
-            int l0 = n % 2, li = 0;
-            for (int l = l0; l <= n; ++li, l += 2)
+            for (std::uint64_t i = reTable.rowOffsets_[row]; i < reTable.rowOffsets_[row + 1]; ++i)
             {
-                zernikeMoments_[n][li].resize(l + 1);
-                for (int m = 0; m <= l; ++m)
-                {
-                    // Zernike moment of according indices [nlm]
-                    ComplexT zm(static_cast<T>(0), static_cast<T>(0));
+                re.Add(reTable.values_[i] * moments[reTable.columns_[i]]);
+            }
 
-                    int nCoeffs = (int)gCoeffs_[n][li][m].size();
-                    for (int i = 0; i < nCoeffs; ++i)
-                    {
-                        ComplexCoeffT cc = gCoeffs_[n][li][m][i];
-                        //T scale = gm_.GetScale ();
-                        //T fact = std::pow (scale, cc.p_+cc.q_+cc.r_+3);
+            for (std::uint64_t i = imTable.rowOffsets_[row]; i < imTable.rowOffsets_[row + 1]; ++i)
+            {
+                im.Add(-(imTable.values_[i] * moments[imTable.columns_[i]]));
+            }
 
-                        //zm +=  std::conj (cc.value_) * gm_.GetMoment(cc.p_, cc.q_, cc.r_) * fact;
-                        zm += std::conj(cc.value_) * gm_.GetMoment(cc.p_, cc.q_, cc.r_);
-                    }
+            zernikeMoments_[row] = ComplexT(re.Get(), im.Get()) * three_quarters_div_pi;
+        }
+    }
 
-                    zm *= three_quarters_div_pi;
+    /**
+ * Computes the Zernike moments of _batchSize objects in one pass over the basis,
+ * so every coefficient is loaded once and used for all objects.
+ * _moments is a dense matrix of the geometrical moments: one row per moment
+ * (see GeometricalMomentIndex()) and one column per object, i.e. the moment
+ * with the index i of the object b is _moments[i * _batchSize + b]. The matrix
+ * has to contain at least all moments up to the order of the basis.
+ * _zms[b] receives the Zernike moments of the object b, all of them have to be
+ * initialized with the same basis.
+ */
+    static void ComputeBatch(const T * _moments, std::size_t _batchSize, ZernikeMoments * const * _zms)
+    {
+        if (_batchSize == 0)
+        {
+            return;
+        }
 
-                    if (n == 0 && l == 0 && m == 0)
-                    {
-                        // FixMe Unused variable! What is it for?
-                        nullMoment = zm.real();
-                    }
-                    zernikeMoments_[n][li][m] = zm;
+        const BasisT * basis = _zms[0]->basis_.get();
+
+        for (std::size_t b = 0; b < _batchSize; ++b)
+        {
+            if (!_zms[b]->basis_ || _zms[b]->basis_.get() != basis)
+            {
+                throw std::invalid_argument("ZernikeMoments<InputVoxelIterator,MomentT>::ComputeBatch(): \
+                     all Zernike moments of a batch have to share one basis.");
+            }
+        }
+
+        constexpr T three_quarters_div_pi = boost::math::constants::three_quarters<T>() * 1 / boost::math::constants::pi<T>();
+
+        const std::size_t rowCount = basis->GetRowCount();
+        const typename BasisT::Table & reTable = basis->GetRealTable();
+        const typename BasisT::Table & imTable = basis->GetImagTable();
+
+        for (std::size_t b = 0; b < _batchSize; ++b)
+        {
+            _zms[b]->zernikeMoments_.resize(rowCount);
+        }
 
-                    //std::cout << "zernike moment[nlm]: " << n << "\t" << l << "\t" << m << "\t" << zernikeMoments_[n][li][m] << "\n";
+        std::vector<MomentSum<T> > re(_batchSize), im(_batchSize);
+
+        for (std::size_t row = 0; row < rowCount; ++row)
+        {
+            std::fill(re.begin(), re.end(), MomentSum<T>());
+            std::fill(im.begin(), im.end(), MomentSum<T>());
+
+            for (std::uint64_t i = reTable.rowOffsets_[row]; i < reTable.rowOffsets_[row + 1]; ++i)
+            {
+                const T value = reTable.values_[i];
+                const T * moments = _moments + reTable.columns_[i] * _batchSize;
+
+                for (std::size_t b = 0; b < _batchSize; ++b)
+                {
+                    re[b].Add(value * moments[b]);
                 }
             }
+
+            for (std::uint64_t i = imTable.rowOffsets_[row]; i < imTable.rowOffsets_[row + 1]; ++i)
+            {
+                const T value = imTable.values_[i];
+                const T * moments = _moments + imTable.columns_[i] * _batchSize;
+
+                for (std::size_t b = 0; b < _batchSize; ++b)
+                {
+                    im[b].Add(-(value * moments[b]));
+                }
+            }
+
+            for (std::size_t b = 0; b < _batchSize; ++b)
+            {
+                _zms[b]->zernikeMoments_[row] = ComplexT(re[b].Get(), im[b].Get()) * three_quarters_div_pi;
+            }
         }
     }
 
@@ -198,7 +247,7 @@ public:
     {
         if (_m >= 0)
         {
-            return zernikeMoments_[_n][_l / 2][_m];
+            return zernikeMoments_[basis_->GetRowIndex(_n, _l / 2, _m)];
         }
         else
         {
@@ -212,7 +261,7 @@ public:
             {
                 sign = static_cast<T>(1);
             }
-            return sign * std::conj(zernikeMoments_[_n][_l / 2][abs(_m)]);
+            return sign * std::conj(zernikeMoments_[basis_->GetRowIndex(_n, _l / 2, abs(_m))]);
         }
     }
 
@@ -295,10 +344,8 @@ public:
 
                                     int absM = std::abs(m);
 
-                                    int nCoeffs = gCoeffs_[n][l / 2][absM].size();
-                                    for (int i = 0; i < nCoeffs; ++i)
+                                    for (const ComplexCoeffT & cc : GetCoefficients(n, l / 2, absM))
                                     {
-                                        ComplexCoeffT cc = gCoeffs_[n][l / 2][absM][i];
                                         ComplexT cvalue = cc.value_;
 
                                         // conjugate if m negative
@@ -378,15 +425,10 @@ public:
         // the total sum of the scalar product
         ComplexT sum(static_cast<T>(0), static_cast<T>(0));
 
-        int nCoeffs1 = (int)gCoeffs_[_n1][li1][_m1].size();
-        int nCoeffs2 = (int)gCoeffs_[_n2][li2][_m2].size();
-
-        for (int i = 0; i < nCoeffs1; ++i)
+        for (const ComplexCoeffT & cc1 : GetCoefficients(_n1, li1, _m1))
         {
-            ComplexCoeffT cc1 = gCoeffs_[_n1][li1][_m1][i];
-            for (int j = 0; j < nCoeffs2; ++j)
+            for (const ComplexCoeffT & cc2 : GetCoefficients(_n2, li2, _m2))
             {
-                ComplexCoeffT cc2 = gCoeffs_[_n2][li2][_m2][j];
 
                 T temp{ 0 };
 
@@ -406,195 +448,44 @@ public:
     }
 
 private:
-    // ---- private member functions ----
-
-/**
- * Computes all the normalizing factors $c_l^m$ for harmonic polynomials e
- */
-    void ComputeCs()
-    {
-        using namespace boost::math;
-
-        /*
-         indexing:
-           l goes from 0 to n
-           m goes from -l to l, in fact from 0 to l, since c(l,-m) = c (l,m)
-        */
-
-        cs_.resize(order_ + 1);
-
-        for (size_t l = 0; l <= order_; ++l)
-        {
-            cs_[l].resize(l + 1);
-            for (size_t m = 0; m <= l; ++m)
-            {
-                /*         T n_sqrt = ((T)2 * l + (T)1) *
-                             Factorial<T>::Get(l + 1, l + m);
-                         T d_sqrt = Factorial<T>::Get(l - m + 1, l);*/
-
-                T n_sqrt = static_cast<T>((2 * l + 1) * rising_factorial(l + 1, m));
-                T d_sqrt = static_cast<T>(rising_factorial(l - m + 1, m));
+    // ---- private attributes -----
+    std::shared_ptr<const BasisT> basis_;   // shared input data independent coefficients
+    ComplexT1D          zernikeMoments_;    // nomen est omen, indexed by the rows of the basis
 
-                cs_[l][m] = std::sqrt(n_sqrt / d_sqrt);
-            }
-        }
-    }
+    int                 order_;             // := max{n} according to indexing of Zernike polynomials
 
+    // ---- debug functions/arguments ----
     /**
- * Computes all coefficients q for orthonormalization of radial polynomials
- * in Zernike polynomials.
+ * Coefficients of the geometrical moments yielding the Zernike moment [n,l,m]
  */
-    void ComputeQs()
+    vector<ComplexCoeffT> GetCoefficients(int _n, int _li, int _m) const
     {
-        using namespace boost::math;
+        std::size_t row = basis_->GetRowIndex(_n, _li, _m);
 
-        /*
-         indexing:
-           n goes 0..order_
-           l goes 0..n, so that n-l is even
-           mu goes 0..(n-l)/2
-        */
+        vector<ComplexCoeffT> coeffs;
 
-        qs_.resize(order_ + 1);            // there is order_ + 1 n's
+        const typename BasisT::Table & reTable = basis_->GetRealTable();
+        const typename BasisT::Table & imTable = basis_->GetImagTable();
 
-        for (size_t n = 0; n <= order_; ++n)
+        for (std::uint64_t i = reTable.rowOffsets_[row]; i < reTable.rowOffsets_[row + 1]; ++i)
         {
-            qs_[n].resize(n / 2 + 1);      // there is floor(n/2) + 1 l's
-
-            size_t l0 = n % 2;
-            for (size_t l = l0; l <= n; l += 2)
-            {
-                size_t k = (n - l) / 2;
-
-                qs_[n][l / 2].resize(k + 1);   // there is k+1 mu's
-
-                for (size_t mu = 0; mu <= k; ++mu)
-                {
-                    T nom = binomial_coefficient<T>(2 * k, k) * // nominator of straight part
-                        binomial_coefficient<T>(k, mu) * binomial_coefficient<T>(2 * (k + l + mu) + 1, 2 * k);
-
-                    if ((k + mu) % 2)
-                    {
-                        nom *= static_cast<T>(-1);
-                    }
-
-                    T den = std::pow(static_cast<T>(2), static_cast<T>(2 * k)) *     // denominator of straight part
-                        binomial_coefficient<T>(k + l + mu, k);
-
-                    T n_sqrt = static_cast<T>(2 * l + 4 * k + 3);      // nominator of sqrt part
-                    T d_sqrt = static_cast<T>(3);                        // denominator of sqrt part
-
-                    qs_[n][l / 2][mu] = nom / den * sqrt(n_sqrt / d_sqrt);
-                }
-            }
+            ComplexCoeffT cc;
+            GeometricalMomentOrder(reTable.columns_[i], cc.p_, cc.q_, cc.r_);
+            cc.value_ = ComplexT(reTable.values_[i], static_cast<T>(0));
+            coeffs.push_back(cc);
         }
-    }
 
-    /**
- * Computes the coefficients of geometrical moments in linear combinations
- * yielding the Zernike moments for each applicable [n,l,m] for n<=order_.
- * For each such combination the coefficients are stored with according
- * geom. moment order (see ComplexCoeff).
- */
-    void ComputeGCoefficients()
-    {
-        using namespace boost::math;
-
-        //DD
-        size_t countCoeffs = 0;
-        //DD
-        gCoeffs_.resize(order_ + 1);
-
-        for (size_t n = 0; n <= order_; ++n)
+        for (std::uint64_t i = imTable.rowOffsets_[row]; i < imTable.rowOffsets_[row + 1]; ++i)
         {
-            gCoeffs_[n].resize(n / 2 + 1);
-            size_t li = 0, l0 = n % 2;
-            for (size_t l = l0; l <= n; ++li, l += 2)
-            {
-                gCoeffs_[n][li].resize(l + 1);
-                for (size_t m = 0; m <= l; ++m)
-                {
-                    T w = cs_[l][m] / std::pow(static_cast<T>(2), static_cast<T>(m));
-
-                    size_t k = (n - l) / 2;
-                    for (size_t nu = 0; nu <= k; ++nu)
-                    {
-                        T w_Nu = w * qs_[n][li][nu];
-                        for (size_t alpha = 0; alpha <= nu; ++alpha)
-                        {
-                            T w_NuA = w_Nu * binomial_coefficient<T>(nu, alpha);
-                            for (size_t beta = 0; beta <= nu - alpha; ++beta)
-                            {
-                                T w_NuAB = w_NuA * binomial_coefficient<T>(nu - alpha, beta);
-                                for (size_t p = 0; p <= m; ++p)
-                                {
-                                    T w_NuABP = w_NuAB * binomial_coefficient<T>(m, p);
-                                    for (size_t mu = 0; mu <= (l - m) / 2; ++mu)
-                                    {
-                                        T w_NuABPMu = w_NuABP *
-                                            binomial_coefficient<T>(l, mu) *
-                                            binomial_coefficient<T>(l - mu, m + mu) /
-                                            static_cast<T>(std::pow(2.0, (double)(2 * mu)));
-                                        for (size_t q = 0; q <= mu; ++q)
-                                        {
-                                            // the absolute value of the coefficient
-                                            T w_NuABPMuQ = w_NuABPMu * binomial_coefficient<T>(mu, q);
-
-                                            // the sign
-                                            if ((m - p + mu) % 2)
-                                            {
-                                                w_NuABPMuQ *= static_cast<T>(-1);
-                                            }
-
-                                            // * i^p
-                                            size_t rest = p % 4;
-                                            ComplexT c;
-                                            switch (rest)
-                                            {
-                                                case 0: c = ComplexT(w_NuABPMuQ, static_cast <T>(0)); break;
-                                                case 1: c = ComplexT(static_cast<T>(0), w_NuABPMuQ); break;
-                                                case 2: c = ComplexT(static_cast<T>(-1) * w_NuABPMuQ, static_cast<T>(0)); break;
-                                                case 3: c = ComplexT(static_cast<T>(0), static_cast<T>(-1) * w_NuABPMuQ); break;
-                                            }
+            ComplexCoeffT cc;
+            GeometricalMomentOrder(imTable.columns_[i], cc.p_, cc.q_, cc.r_);
+            cc.value_ = ComplexT(static_cast<T>(0), imTable.values_[i]);
+            coeffs.push_back(cc);
+        }
 
-                                            // determination of the order of according moment
-                                            int z_i = l - m + 2 * (nu - alpha - beta - mu);
-                                            int y_i = 2 * (mu - q + beta) + m - p;
-                                            int x_i = 2 * q + p + 2 * alpha;
-                                            //DD
-                                                                                    //std::cout << x_i << " " << y_i << " " << z_i;
-                                                                                    //std::cout << "\t" << n << " " << l << " " << m;
-                                                                                    //std::cout << "\t" << c.real () << " " << c.imag () << std::endl;
-                                            //DD
-                                            ComplexCoeffT cc(x_i, y_i, z_i, c);
-                                            gCoeffs_[n][li][m].push_back(cc);
-                                            //DD
-                                            countCoeffs++;
-                                            //DD
-                                        } // q
-                                    } // mu
-                                } // p
-                            } // beta
-                        } // alpha
-                    } // nu
-                } // m
-            } // l
-        } // n
-    //DD
-        //std::cout << countCoeffs << std::endl;
-        //DD
+        return coeffs;
     }
 
-    // ---- private attributes -----
-    ComplexCoeffT4D     gCoeffs_;           // coefficients of the geometric moments
-    ComplexT3D          zernikeMoments_;    // nomen est omen
-    T3D                 qs_;                // q coefficients (radial polynomial normalization)
-    T2D                 cs_;                // c coefficients (harmonic polynomial normalization)
-
-    ScaledGeometricalMoments<InputVoxelIterator, MomentT> gm_;
-    int                 order_;             // := max{n} according to indexing of Zernike polynomials
-
-    // ---- debug functions/arguments ----
     void PrintGrid(ComplexT3D & _grid)
     {
         int xD = _grid.size();
@@ -4,22 +4,26 @@
 
 #include "stdafx.h"
 #include "loggers.h"
+#include "binvox_utils.hpp"
+#include "BitVoxelGrid.hpp"
+#include "BrickVoxelGrid.hpp"
+#include "VoxelSegments.hpp"
 
 namespace io
 {
     namespace binvox
     {
         // Original code was imported https://www.patrickmin.com/binvox/read_binvox.cc and slightly modified
-        template<typename VoxelType>
-        bool read_binvox(const boost::filesystem::path & path_to_file, std::vector<VoxelType> & voxels, std::size_t & dim)
+        // Calls on_run(value, index, count) for every run of the voxel data. index is the position of the first voxel in binvox order.
+        // dims are set before the first call. Grids with unequal dimensions are rejected if is_cubic is set.
+        template<typename RunVisitor>
+        bool read_binvox_runs(const boost::filesystem::path & path_to_file, ::binvox::GridDims & dims, bool is_cubic, RunVisitor && on_run)
         {
-            static_assert(std::is_integral<VoxelType>::value || std::is_floating_point<VoxelType>::value, "Voxel type must be integral or float");
-
             logging::logger_t & logger = logging::logger_io::get();
 
             using byte = unsigned char;
 
-            dim = 0;
+            dims = ::binvox::GridDims{};
 
             std::ifstream input{ path_to_file.string(), std::ios::in | std::ios::binary };
 
@@ -82,14 +86,15 @@ namespace io
                         return false;
                     }
 
-                    if (depth != height || depth != width)
+                    if (is_cubic && (depth != height || depth != width))
                     {
                         BOOST_LOG_SEV(logger, logging::severity_t::trace) << "Voxel has unequal dimensions." << std::endl;
                         return false;
                     }
                     else
                     {
-                        dim = depth;
+                        // binvox index is (x * height + z) * width + y
+                        dims = ::binvox::GridDims{ depth, width, height };
                     }
                 }
                 else
@@ -115,7 +120,7 @@ namespace io
                 return false;
             }
 
-            if (depth == 0)
+            if (depth == 0 || height == 0 || width == 0)
             {
                 BOOST_LOG_SEV(logger, logging::severity_t::trace) << "Missing dimensions in header." << std::endl;
                 return false;
@@ -123,8 +128,6 @@ namespace io
 
             std::size_t size = width * height * depth;
 
-            voxels.resize(size);
-
             //
             // read voxel data
             //
@@ -158,10 +161,7 @@ namespace io
                         return false;
                     }
 
-                    for (std::size_t i{ index }; i < end_index; i++)
-                    {
-                        voxels.at(i) = static_cast<VoxelType>(value);
-                    }
+                    on_run(value, index, static_cast<std::size_t>(count));
 
                     if (value)
                     {
@@ -178,5 +178,181 @@ namespace io
 
             return true;
         }
+
+        // The same for the cubic grids only, dim is the length of their edge
+        template<typename RunVisitor>
+        bool read_binvox_runs(const boost::filesystem::path & path_to_file, std::size_t & dim, RunVisitor && on_run)
+        {
+            ::binvox::GridDims dims;
+
+            dim = 0;
+
+            return read_binvox_runs(path_to_file, dims, true, [&](unsigned char value, std::size_t index, std::size_t count)
+            {
+                dim = dims.x;
+                on_run(value, index, count);
+            });
+        }
+
+        // Reads a grid of any dimensions in binvox order
+        template<typename VoxelType>
+        bool read_binvox(const boost::filesystem::path & path_to_file, std::vector<VoxelType> & voxels, ::binvox::GridDims & dims)
+        {
+            static_assert(std::is_integral<VoxelType>::value || std::is_floating_point<VoxelType>::value, "Voxel type must be integral or float");
+
+            return read_binvox_runs(path_to_file, dims, false, [&](unsigned char value, std::size_t index, std::size_t count)
+            {
+                if (voxels.size() != dims.size())
+                {
+                    voxels.resize(dims.size());
+                }
+
+                std::fill(voxels.begin() + index, voxels.begin() + index + count, static_cast<VoxelType>(value));
+            });
+        }
+
+        template<typename VoxelType>
+        bool read_binvox(const boost::filesystem::path & path_to_file, std::vector<VoxelType> & voxels, std::size_t & dim)
+        {
+            static_assert(std::is_integral<VoxelType>::value || std::is_floating_point<VoxelType>::value, "Voxel type must be integral or float");
+
+            return read_binvox_runs(path_to_file, dim, [&](unsigned char value, std::size_t index, std::size_t count)
+            {
+                if (voxels.size() != dim * dim * dim)
+                {
+                    voxels.resize(dim * dim * dim);
+                }
+
+                std::fill(voxels.begin() + index, voxels.begin() + index + count, static_cast<VoxelType>(value));
+            });
+        }
+
+        // Reads the set voxels as segments in canonical order without expanding the grid, see VoxelSegments
+        inline bool read_binvox(const boost::filesystem::path & path_to_file, VoxelSegments & segments, std::size_t & dim)
+        {
+            segments.Reset(0);
+
+            return read_binvox_runs(path_to_file, dim, [&](unsigned char value, std::size_t index, std::size_t count)
+            {
+                if (segments.GetDim() == 0)
+                {
+                    segments.Reset(static_cast<int>(dim));
+                }
+
+                if (value)
+                {
+                    ::binvox::utils::add_run_to_segments(segments, index, count, dim);
+                }
+            });
+        }
+
+        // Reads the set voxels plane by plane and calls on_plane(const VoxelSegments &) for every plane x which has set voxels.
+        // Binvox order is x, z, y with x running slowest, so only one plane is kept in memory. Planes are visited before
+        // an error can be detected, the caller must discard them if the function returns false.
+        template<typename PlaneVisitor>
+        bool read_binvox_planes(const boost::filesystem::path & path_to_file, std::size_t & dim, PlaneVisitor && on_plane)
+        {
+            VoxelSegments plane;
+            std::size_t plane_x{ 0 };
+
+            bool is_read = read_binvox_runs(path_to_file, dim, [&](unsigned char value, std::size_t index, std::size_t count)
+            {
+                if (plane.GetDim() == 0)
+                {
+                    plane.Reset(static_cast<int>(dim));
+                }
+
+                if (!value)
+                {
+                    return;
+                }
+
+                std::size_t plane_size{ dim * dim };
+                std::size_t end_index{ index + count };
+
+                while (index < end_index)
+                {
+                    std::size_t x{ index / plane_size };
+                    std::size_t plane_end{ std::min(end_index, (x + 1) * plane_size) };
+
+                    if (x != plane_x)
+                    {
+                        if (plane.GetVoxelCount() != 0)
+                        {
+                            on_plane(static_cast<const VoxelSegments &>(plane));
+                        }
+
+                        plane.Reset(static_cast<int>(dim));
+                        plane_x = x;
+                    }
+
+                    ::binvox::utils::add_run_to_segments(plane, index, plane_end - index, dim);
+
+                    index = plane_end;
+                }
+            });
+
+            if (is_read && plane.GetVoxelCount() != 0)
+            {
+                on_plane(static_cast<const VoxelSegments &>(plane));
+            }
+
+            return is_read;
+        }
+
+        // Reads the voxels into a bit-packed grid in canonical order, see BitVoxelGrid
+        inline bool read_binvox(const boost::filesystem::path & path_to_file, BitVoxelGrid & grid, std::size_t & dim)
+        {
+            grid.Reset(0);
+
+            return read_binvox_runs(path_to_file, dim, [&](unsigned char value, std::size_t index, std::size_t count)
+            {
+                if (grid.GetDim() == 0)
+                {
+                    grid.Reset(static_cast<int>(dim));
+                }
+
+                if (value)
+                {
+                    ::binvox::utils::add_run_to_bits(grid, index, count, dim);
+                }
+            });
+        }
+
+        // Reads the voxels into a sparse brick grid in canonical order, see BrickVoxelGrid. Binvox order runs along x slowest,
+        // so a slab of bricks is complete and compacted as soon as the runs reach the next one.
+        inline bool read_binvox(const boost::filesystem::path & path_to_file, BrickVoxelGrid & grid, std::size_t & dim)
+        {
+            grid.Reset(0);
+
+            int slab{ 0 };
+
+            bool is_read = read_binvox_runs(path_to_file, dim, [&](unsigned char value, std::size_t index, std::size_t count)
+            {
+                if (grid.GetDim() == 0)
+                {
+                    grid.Reset(static_cast<int>(dim));
+                }
+
+                int run_slab{ static_cast<int>(index / (dim * dim)) / BrickVoxelGrid::brickDim };
+
+                for (; slab < run_slab; slab++)
+                {
+                    grid.Compact(slab);
+                }
+
+                if (value)
+                {
+                    ::binvox::utils::add_run_to_bricks(grid, index, count, dim);
+                }
+            });
+
+            for (; slab < grid.GetBricksPerEdge(); slab++)
+            {
+                grid.Compact(slab);
+            }
+
+            return is_read;
+        }
     }
 }
\ No newline at end of file
@@ -1,23 +1,103 @@
 #pragma once
 
+#include <algorithm>
+
+#include "BitVoxelGrid.hpp"
+#include "BrickVoxelGrid.hpp"
+#include "VoxelSegments.hpp"
+
 namespace binvox
 {
+    // Edges of a voxel grid along the canonical axes. The binvox header gives them as depth (x), height (z) and width (y).
+    struct GridDims
+    {
+        size_t x{}, y{}, z{};
+
+        bool is_cubic() const
+        {
+            return x == y && x == z;
+        }
+
+        size_t size() const
+        {
+            return x * y * z;
+        }
+    };
+
     namespace utils
     {
-        // Change default order of binvox y z x -> x y z
+        // Change default order of binvox y z x -> x y z, the canonical index is (z * dims.y + y) * dims.x + x
         template<typename VoxelIterator>
-        void convert_to_canonical_order(VoxelIterator input, VoxelIterator output, size_t dim)
+        void convert_to_canonical_order(VoxelIterator input, VoxelIterator output, const GridDims & dims)
         {
-            for (size_t x = 0; x < dim; x++)
+            for (size_t x = 0; x < dims.x; x++)
             {
-                for (size_t z = 0; z < dim; z++)
+                for (size_t z = 0; z < dims.z; z++)
                 {
-                    for (size_t y = 0; y < dim; y++)
+                    for (size_t y = 0; y < dims.y; y++)
                     {
-                        output[(z * dim + y) * dim + x] = input[(x * dim + z) * dim + y];
+                        output[(z * dims.y + y) * dims.x + x] = input[(x * dims.z + z) * dims.y + y];
                     }
                 }
             }
         }
+
+        template<typename VoxelIterator>
+        void convert_to_canonical_order(VoxelIterator input, VoxelIterator output, size_t dim)
+        {
+            convert_to_canonical_order(input, output, GridDims{ dim, dim, dim });
+        }
+
+        // Adds the run of count set voxels starting at index in binvox order to segments in canonical order.
+        // Binvox order is x, z, y with y running fastest, so a run splits into segments along y.
+        inline void add_run_to_segments(VoxelSegments & segments, size_t index, size_t count, size_t dim)
+        {
+            size_t end_index{ index + count };
+
+            while (index < end_index)
+            {
+                size_t y{ index % dim };
+                size_t z{ index / dim % dim };
+                size_t x{ index / (dim * dim) };
+                size_t length{ std::min(end_index - index, dim - y) };
+
+                segments.Add(static_cast<int>(x), static_cast<int>(z), static_cast<int>(y), static_cast<int>(y + length));
+
+                index += length;
+            }
+        }
+
+        // Sets the voxels of the run of count set voxels starting at index in binvox order in the brick grid.
+        // Binvox order is x, z, y with y running fastest, so a run splits into runs along y.
+        inline void add_run_to_bricks(BrickVoxelGrid & grid, size_t index, size_t count, size_t dim)
+        {
+            size_t end_index{ index + count };
+
+            while (index < end_index)
+            {
+                size_t y{ index % dim };
+                size_t z{ index / dim % dim };
+                size_t x{ index / (dim * dim) };
+                size_t length{ std::min(end_index - index, dim - y) };
+
+                grid.SetRun(static_cast<int>(x), static_cast<int>(z), static_cast<int>(y), static_cast<int>(y + length));
+
+                index += length;
+            }
+        }
+
+        // Sets the voxels of the run of count set voxels starting at index in binvox order in the bit-packed grid.
+        // The words of the grid go along x, so every voxel of the run is set separately.
+        inline void add_run_to_bits(BitVoxelGrid & grid, size_t index, size_t count, size_t dim)
+        {
+            for (size_t end_index{ index + count }; index < end_index; index++)
+            {
+                size_t y{ index % dim };
+                size_t z{ index / dim % dim };
+                size_t x{ index / (dim * dim) };
+
+                grid.Set(static_cast<int>(x), static_cast<int>(y), static_cast<int>(z), true);
+            }
+        }
     }
 }
\ No newline at end of file
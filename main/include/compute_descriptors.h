@@ -5,6 +5,8 @@
 #include "stdafx.h"
 #include "binvox_reader.hpp"
 #include "ZernikeDescriptor.hpp"
+#include "VoxelPyramid.hpp"
+#include "FixedZernikeBases.hpp"
 #include "loggers.h"
 #include "binvox_utils.hpp"
 #include "compute_sha256.h"
@@ -13,11 +15,44 @@
 
 namespace parallel
 {
+    using DescriptorType = double;
+    using VoxelType = bool;
+    using Container = std::vector<VoxelType>;
+
+    // Voxels of the downsampled dense grids, the fraction of the set voxels of a block, see VoxelPyramid
+    using CoarseVoxelType = float;
+    using CoarseContainer = std::vector<CoarseVoxelType>;
+
+    // How the workers read the voxel grid of a binvox file:
+    // dense - the grid is expanded and reordered, runs - the moments are computed from the run-length encoded data, see VoxelSegments,
+    // bits - the grid is packed into 64-bit words, see BitVoxelGrid,
+    // stream - the file is read twice plane by plane and the grid is never kept in memory, the result equals runs,
+    // bricks - the grid is kept as sparse bricks of 8^3 voxels which are empty, full or mixed, see BrickVoxelGrid
+    enum class VoxelInput
+    {
+        dense,
+        runs,
+        bits,
+        stream,
+        bricks
+    };
+
     // Queue stores an absolute path as two parts: parent path and path relative to directory with data.
     using TasksQueue = boost::lockfree::stack <std::tuple<boost::filesystem::path, boost::filesystem::path, std::string>, boost::lockfree::fixed_sized<true>>;
 
+    // Dense grids with dim >= slab_dim are split into z-slabs on a thread pool shared by the workers, see ThreadPool.
+    // With downsample > 1 dense grids are box-filtered by this factor, a power of 2, before the descriptors are computed, see VoxelPyramid.
+    // With store_moments the geometrical moments of every computed file are saved to db, see db::MomentsSchema.
+    // orders are sorted ascending without duplicates, the moments are computed once for the last one and serve all orders.
     void recursive_compute(const boost::filesystem::path & input_dir,
-        int max_order, std::size_t max_queue_size, std::size_t max_worker_thread, sqlite::database & db);
+        const std::vector<int> & orders, std::size_t max_queue_size, std::size_t max_worker_thread, std::size_t batch_size, VoxelInput voxel_input, std::size_t slab_dim, std::size_t downsample, bool store_moments, const boost::filesystem::path & basis_file, sqlite::database & db);
+
+    // Maps the basis of max_order from basis_file or computes it and saves it to basis_file.
+    // An empty path means that the basis is computed in memory only.
+    void init_basis(int max_order, const boost::filesystem::path & basis_file);
 
-    void compute_descriptor(TasksQueue & queue, int max_order, std::atomic_bool & is_stop, sqlite::database & db);
+    // batch_size is the number of files which geometrical moments are collected before the Zernike moments are computed for all of them at once.
+    // Files with stored moments of at least the highest order are not read, for lower stored orders the stored normalization is used.
+    // A row is written for every order in orders, the rows of a batch are saved in one transaction.
+    void compute_descriptor(TasksQueue & queue, const std::vector<int> & orders, std::size_t batch_size, VoxelInput voxel_input, ThreadPool & slab_pool, std::size_t slab_dim, std::size_t downsample, bool store_moments, std::atomic_bool & is_stop, sqlite::database & db);
 }
\ No newline at end of file
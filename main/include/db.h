@@ -42,6 +42,12 @@ namespace db
             return u8"descriptor";
         }
 
+        // Factor of the box filter of the grid of the descriptor, 1 for the full grid, see VoxelPyramid
+        static constexpr const char * downsample_column()
+        {
+            return u8"downsample";
+        }
+
         static constexpr const char * table_name()
         {
             return u8"zernike_descriptors";
@@ -58,7 +64,8 @@ namespace db
                 << max_order_column() << u8" INTEGER NOT NULL CHECK(" << max_order_column() << u8" > 0), "
                 << desc_length_column() << u8" INTEGER NOT NULL CHECK(" << desc_length_column() << u8" > 0),"
                 << desc_value_size_bytes_column() << u8" INTEGER NOT NULL CHECK(" << desc_value_size_bytes_column() << u8" > 0),"
-                << descriptor_column() << u8" BLOB"
+                << descriptor_column() << u8" BLOB,"
+                << downsample_column() << u8" " << downsample_column_ddl()
                 << ')';
 
             return query.str();
@@ -69,6 +76,23 @@ namespace db
             std::string ddl_query{ create_table_ddl() };
             db << ddl_query;
 
+            {
+                // the tables of earlier versions have no downsample column, their rows are of full grids
+                std::stringstream column_query;
+                column_query << u8"SELECT count(*) FROM pragma_table_info('" << table_name() << u8"') WHERE name = '" << downsample_column() << '\'';
+
+                int column_count{};
+                db << column_query.str() >> column_count;
+
+                if (column_count == 0)
+                {
+                    std::stringstream alter_query;
+                    alter_query << u8"ALTER TABLE " << table_name() << u8" ADD COLUMN " << downsample_column() << u8" " << downsample_column_ddl();
+
+                    db << alter_query.str();
+                }
+            }
+
             {
                 std::stringstream file_hash_index_query;
                 file_hash_index_query << u8"CREATE INDEX IF NOT EXISTS hash_index ON " << table_name() << u8" (" << file_hash_column() << ')';
@@ -82,5 +106,106 @@ namespace db
                 db << path_index_query.str();
             }
         }
+
+    private:
+        static std::string downsample_column_ddl()
+        {
+            std::stringstream ddl;
+            ddl << u8"INTEGER NOT NULL DEFAULT 1 CHECK(" << downsample_column() << u8" > 0)";
+
+            return ddl.str();
+        }
+    };
+
+    // Geometrical moments of a file together with the normalization of its grid, see ZernikeDescriptor::Normalization.
+    // They give the descriptors of lower orders without the voxel file and the normalization for higher orders.
+    class MomentsSchema
+    {
+    public:
+        static constexpr const char * path_column()
+        {
+            return u8"path";
+        }
+
+        static constexpr const char * file_hash_column()
+        {
+            return u8"file_hash_sha256";
+        }
+
+        static constexpr const char * max_order_column()
+        {
+            return u8"max_order";
+        }
+
+        static constexpr const char * dim_column()
+        {
+            return u8"dim";
+        }
+
+        static constexpr const char * zero_moment_column()
+        {
+            return u8"zero_moment";
+        }
+
+        static constexpr const char * x_cog_column()
+        {
+            return u8"x_cog";
+        }
+
+        static constexpr const char * y_cog_column()
+        {
+            return u8"y_cog";
+        }
+
+        static constexpr const char * z_cog_column()
+        {
+            return u8"z_cog";
+        }
+
+        static constexpr const char * scale_column()
+        {
+            return u8"scale";
+        }
+
+        static constexpr const char * value_size_bytes_column()
+        {
+            return u8"value_size_bytes";
+        }
+
+        static constexpr const char * moments_column()
+        {
+            return u8"moments";
+        }
+
+        static constexpr const char * table_name()
+        {
+            return u8"geometrical_moments";
+        }
+
+        static std::string create_table_ddl()
+        {
+            std::stringstream query;
+            query << u8"CREATE TABLE IF NOT EXISTS "
+                << table_name()
+                << u8" (" << path_column() << u8" TEXT PRIMARY KEY NOT NULL CHECK(length(" << path_column() << u8") > 0),"
+                << file_hash_column() << u8" TEXT NOT NULL CHECK(length(" << file_hash_column() << u8") > 0),"
+                << max_order_column() << u8" INTEGER NOT NULL CHECK(" << max_order_column() << u8" > 0),"
+                << dim_column() << u8" INTEGER NOT NULL CHECK(" << dim_column() << u8" > 0),"
+                << zero_moment_column() << u8" REAL NOT NULL,"
+                << x_cog_column() << u8" REAL NOT NULL,"
+                << y_cog_column() << u8" REAL NOT NULL,"
+                << z_cog_column() << u8" REAL NOT NULL,"
+                << scale_column() << u8" REAL NOT NULL,"
+                << value_size_bytes_column() << u8" INTEGER NOT NULL CHECK(" << value_size_bytes_column() << u8" > 0),"
+                << moments_column() << u8" BLOB"
+                << ')';
+
+            return query.str();
+        }
+
+        static void init_db(sqlite::database & db)
+        {
+            db << create_table_ddl();
+        }
     };
 }
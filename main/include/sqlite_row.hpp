@@ -4,6 +4,7 @@
 
 #include "stdafx.h"
 #include "db.h"
+#include "ScaledGeometricMoments.hpp"
 
 namespace sqldata
 {
@@ -14,8 +15,9 @@ namespace sqldata
         std::string file_hash;
         std::vector <DescriptorType> descriptor;
         int max_order;
+        int downsample;
 
-        Row(const std::string & generic_path, const std::string & hash, const std::vector <DescriptorType> & descriptor, int max_order) : generic_path(generic_path), file_hash(hash), descriptor(descriptor), max_order(max_order)
+        Row(const std::string & generic_path, const std::string & hash, const std::vector <DescriptorType> & descriptor, int max_order, int downsample = 1) : generic_path(generic_path), file_hash(hash), descriptor(descriptor), max_order(max_order), downsample(downsample)
         {
         }
     };
@@ -33,14 +35,16 @@ namespace sqldata
             << DbSchema::desc_length_column() << ','
             << DbSchema::desc_value_size_bytes_column() << ','
             << DbSchema::descriptor_column() << ','
-            << DbSchema::max_order_column() << u8") VALUES (?, ?, ?, ?, ?, ?)";
+            << DbSchema::max_order_column() << ','
+            << DbSchema::downsample_column() << u8") VALUES (?, ?, ?, ?, ?, ?, ?)";
         db << insert_query.str()
             << row.generic_path
             << row.file_hash
             << row.descriptor.size()
             << sizeof(DescriptorType)
             << row.descriptor
-            << row.max_order;
+            << row.max_order
+            << row.downsample;
 
         return db;
     }
@@ -53,12 +57,111 @@ namespace sqldata
             << row.descriptor.size()
             << sizeof(DescriptorType)
             << row.descriptor
-            << row.max_order;
+            << row.max_order
+            << row.downsample;
         db_binder++;
 
         return db_binder;
     }
 
+    // Geometrical moments of a file and the normalization of its grid, see db::MomentsSchema
+    template<typename MomentType>
+    struct MomentsRow
+    {
+        std::string generic_path;
+        std::string file_hash;
+        int max_order{};
+        std::size_t dim{};
+        MomentType zero_moment{}, x_cog{}, y_cog{}, z_cog{}, scale{};
+        std::vector<MomentType> moments;
+    };
+
+    // Replaces the moments of the same path
+    template<typename MomentType>
+    sqlite::database & operator<<(sqlite::database & db, const MomentsRow<MomentType> & row)
+    {
+        std::stringstream insert_query;
+
+        using namespace db;
+
+        insert_query << u8"INSERT OR REPLACE INTO " << MomentsSchema::table_name() << '('
+            << MomentsSchema::path_column() << ','
+            << MomentsSchema::file_hash_column() << ','
+            << MomentsSchema::max_order_column() << ','
+            << MomentsSchema::dim_column() << ','
+            << MomentsSchema::zero_moment_column() << ','
+            << MomentsSchema::x_cog_column() << ','
+            << MomentsSchema::y_cog_column() << ','
+            << MomentsSchema::z_cog_column() << ','
+            << MomentsSchema::scale_column() << ','
+            << MomentsSchema::value_size_bytes_column() << ','
+            << MomentsSchema::moments_column() << u8") VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)";
+        db << insert_query.str()
+            << row.generic_path
+            << row.file_hash
+            << row.max_order
+            << row.dim
+            << row.zero_moment
+            << row.x_cog
+            << row.y_cog
+            << row.z_cog
+            << row.scale
+            << sizeof(MomentType)
+            << row.moments;
+
+        return db;
+    }
+
+    // Reads the stored moments of a file with the given hash. Returns false if there are none or they were stored with another moment type.
+    template<typename MomentType>
+    bool select_moments(sqlite::database & db, const std::string & generic_path, const std::string & file_hash, MomentsRow<MomentType> & row)
+    {
+        std::stringstream select_query;
+
+        using namespace db;
+
+        select_query << u8"SELECT "
+            << MomentsSchema::max_order_column() << ','
+            << MomentsSchema::dim_column() << ','
+            << MomentsSchema::zero_moment_column() << ','
+            << MomentsSchema::x_cog_column() << ','
+            << MomentsSchema::y_cog_column() << ','
+            << MomentsSchema::z_cog_column() << ','
+            << MomentsSchema::scale_column() << ','
+            << MomentsSchema::value_size_bytes_column() << ','
+            << MomentsSchema::moments_column()
+            << u8" FROM " << MomentsSchema::table_name()
+            << u8" WHERE " << MomentsSchema::path_column() << u8" = ? AND " << MomentsSchema::file_hash_column() << u8" = ?";
+
+        bool is_found{ false };
+
+        db << select_query.str()
+            << generic_path
+            << file_hash
+            >> [&](int max_order, long long dim, double zero_moment, double x_cog, double y_cog, double z_cog, double scale, long long value_size, std::vector<MomentType> moments)
+        {
+            if (value_size != static_cast<long long>(sizeof(MomentType)) || max_order <= 0 || dim <= 0 ||
+                moments.size() < GeometricalMomentCount(max_order))
+            {
+                return;
+            }
+
+            row.generic_path = generic_path;
+            row.file_hash = file_hash;
+            row.max_order = max_order;
+            row.dim = static_cast<std::size_t>(dim);
+            row.zero_moment = static_cast<MomentType>(zero_moment);
+            row.x_cog = static_cast<MomentType>(x_cog);
+            row.y_cog = static_cast<MomentType>(y_cog);
+            row.z_cog = static_cast<MomentType>(z_cog);
+            row.scale = static_cast<MomentType>(scale);
+            row.moments = std::move(moments);
+            is_found = true;
+        };
+
+        return is_found;
+    }
+
     template<typename TData>
     class CollectionRows
     {
@@ -93,7 +196,8 @@ namespace sqldata
                 << DbSchema::desc_length_column() << ','
                 << DbSchema::desc_value_size_bytes_column() << ','
                 << DbSchema::descriptor_column() << ','
-                << DbSchema::max_order_column() << u8") VALUES (?, ?, ?, ?, ?, ?)";
+                << DbSchema::max_order_column() << ','
+                << DbSchema::downsample_column() << u8") VALUES (?, ?, ?, ?, ?, ?, ?)";
 
             auto query = db << insert_query.str();
 
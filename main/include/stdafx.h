@@ -17,10 +17,14 @@
 #include <sstream>
 #include <set>
 #include <stack>
+#include <mutex>
+#include <algorithm>
 
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
 #include <boost/lockfree/stack.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 #include <boost/log/common.hpp>
 #include <boost/log/attributes.hpp>
 #include <boost/log/utility/setup/from_stream.hpp>
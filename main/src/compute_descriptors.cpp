@@ -2,7 +2,77 @@
 // PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
 #include "compute_descriptors.h"
 
-void parallel::recursive_compute(const boost::filesystem::path & input_dir, int max_order, std::size_t queue_size, std::size_t max_thread, sqlite::database & db)
+namespace
+{
+    // The workers and the directory walk share one connection, statements must not run inside a transaction of another thread
+    std::mutex db_write_mutex;
+
+    // Dense grids up to this dimension are computed one grid per SIMD lane, see ZernikeDescriptor::ComputeLanes()
+    constexpr std::size_t lane_max_dim{ 64 };
+}
+
+void parallel::init_basis(int max_order, const boost::filesystem::path & basis_file)
+{
+    using namespace std;
+    using namespace boost::filesystem;
+    using namespace logging;
+
+    using BasisT = ZernikeBasis<DescriptorType>;
+
+    logger_t & logger = logger_z3d::get();
+
+    auto log_removed_terms = [&logger](const BasisT & basis)
+    {
+        const auto & removed = basis.GetRemovedTermCounts();
+
+        for (size_t n{ 0 }; n < removed.size(); n++)
+        {
+            BOOST_LOG_SEV(logger, severity_t::debug) << u8"Order " << n << u8": merged " << removed[n] << u8" duplicate terms of the basis" << endl;
+        }
+    };
+
+    if (basis_file.empty())
+    {
+        log_removed_terms(*BasisT::Get(max_order));
+        return;
+    }
+
+    if (exists(basis_file))
+    {
+        try
+        {
+            BasisT::Register(BasisT::Load(basis_file.string(), max_order));
+            BOOST_LOG_SEV(logger, severity_t::info) << u8"Mapped basis of order " << max_order << u8" from " << basis_file << endl;
+            return;
+        }
+        catch (const runtime_error & exc)
+        {
+            BOOST_LOG_SEV(logger, severity_t::warning) << exc.what() << endl << u8"Recompute basis." << endl;
+        }
+    }
+
+    auto basis = BasisT::Get(max_order);
+    log_removed_terms(*basis);
+
+    // Other processes may map the file at the same time. Write a temporary file and replace the old one.
+    path temp_file{ basis_file };
+    temp_file += unique_path(u8".%%%%-%%%%.tmp");
+
+    try
+    {
+        basis->Save(temp_file.string());
+        rename(temp_file, basis_file);
+        BOOST_LOG_SEV(logger, severity_t::info) << u8"Saved basis of order " << max_order << u8" to " << basis_file << endl;
+    }
+    catch (const exception & exc)
+    {
+        BOOST_LOG_SEV(logger, severity_t::warning) << u8"Cannot save basis to " << basis_file << endl << exc.what() << endl;
+        boost::system::error_code error;
+        remove(temp_file, error);
+    }
+}
+
+void parallel::recursive_compute(const boost::filesystem::path & input_dir, const std::vector<int> & orders, std::size_t queue_size, std::size_t max_thread, std::size_t batch_size, VoxelInput voxel_input, std::size_t slab_dim, std::size_t downsample, bool store_moments, const boost::filesystem::path & basis_file, sqlite::database & db)
 {
     using namespace std;
     using namespace boost::filesystem;
@@ -10,10 +80,24 @@ void parallel::recursive_compute(const boost::filesystem::path & input_dir, int
 
     logger_t & logger = logger_main::get();
 
+    // the orders are ascending, the moments are computed once for the highest one
+    const int max_order{ orders.back() };
+
+    // "10,16,20" for the queries and the log, the orders are validated integers
+    string order_list;
+
+    for (int order : orders)
+    {
+        order_list += (order_list.empty() ? u8"" : u8",") + to_string(order);
+    }
+
     TasksQueue all_voxel_paths{ queue_size };
 
     vector<thread> working_threads{ max_thread };
 
+    // The worker with a large grid uses it together with its own thread
+    ThreadPool slab_pool{ static_cast<unsigned>(max_thread - 1) };
+
     atomic_bool is_stop{ false };
 
     using NodeType = tree::Node<std::string>;
@@ -30,9 +114,16 @@ void parallel::recursive_compute(const boost::filesystem::path & input_dir, int
         return;
     }
 
+    // The basis does not depend on the data. It is built once and shared by all workers.
+    // Orders with compile-time coefficient tables do not need it at all.
+    if (!VisitFixedZernikeOrder(max_order, [](auto) {}))
+    {
+        init_basis(max_order, basis_file);
+    }
+
     for (size_t i{ 0 }; i < working_threads.size(); i++)
     {
-        working_threads.at(i) = thread(compute_descriptor, ref(all_voxel_paths), max_order, ref(is_stop), ref(db));
+        working_threads.at(i) = thread(compute_descriptor, ref(all_voxel_paths), cref(orders), batch_size, voxel_input, ref(slab_pool), slab_dim, downsample, store_moments, ref(is_stop), ref(db));
     }
 
     auto iterator = recursive_directory_iterator(input_dir);
@@ -77,12 +168,16 @@ void parallel::recursive_compute(const boost::filesystem::path & input_dir, int
                     {
                         BOOST_LOG_SEV(logger, severity_t::debug) << u8"File: " << local_file << " changed. Need to recompute." << endl;
 
-                        stringstream delete_query;
+                        stringstream delete_query, delete_moments_query;
 
-                        delete_query << u8"DELETE FROM " << db::DbSchema::table_name() << " WHERE " << db::DbSchema::path_column() << " = ?" << relative_path.generic_string();
+                        delete_query << u8"DELETE FROM " << db::DbSchema::table_name() << " WHERE " << db::DbSchema::path_column() << " = ?";
+                        delete_moments_query << u8"DELETE FROM " << db::MomentsSchema::table_name() << " WHERE " << db::MomentsSchema::path_column() << " = ?";
                         try
                         {
-                            db << delete_query.str();
+                            lock_guard<mutex> lock{ db_write_mutex };
+
+                            db << delete_query.str() << relative_path.generic_string();
+                            db << delete_moments_query.str() << relative_path.generic_string();
                         }
                         catch (const sqlite::sqlite_exception & exc)
                         {
@@ -96,15 +191,19 @@ void parallel::recursive_compute(const boost::filesystem::path & input_dir, int
 
                         long count{};
 
-                        select_query << u8"SELECT count(*) FROM " << db::DbSchema::table_name()
+                        // the descriptors of another downsample factor do not count
+                        select_query << u8"SELECT count(DISTINCT " << db::DbSchema::max_order_column() << ") FROM " << db::DbSchema::table_name()
                             << " WHERE " << db::DbSchema::path_column() << " = ? AND "
-                            << db::DbSchema::max_order_column() << " = ?";
+                            << db::DbSchema::downsample_column() << " = ? AND "
+                            << db::DbSchema::max_order_column() << " IN (" << order_list << ')';
 
                         try
                         {
+                            lock_guard<mutex> lock{ db_write_mutex };
+
                             db << select_query.str()
                                 << relative_path.generic_string()
-                                << max_order
+                                << static_cast<int>(downsample)
                                 >> count;
                         }
                         catch (const sqlite::sqlite_exception & exc)
@@ -113,14 +212,37 @@ void parallel::recursive_compute(const boost::filesystem::path & input_dir, int
                             continue;
                         }
 
-                        if (count > 0)
+                        if (count == static_cast<long>(orders.size()))
                         {
                             need_recompute = false;
                         }
 
+                        if (need_recompute && count > 0)
+                        {
+                            // all orders are written again by the worker
+                            stringstream delete_query;
+
+                            delete_query << u8"DELETE FROM " << db::DbSchema::table_name()
+                                << " WHERE " << db::DbSchema::path_column() << " = ? AND "
+                                << db::DbSchema::downsample_column() << " = ? AND "
+                                << db::DbSchema::max_order_column() << " IN (" << order_list << ')';
+
+                            try
+                            {
+                                lock_guard<mutex> lock{ db_write_mutex };
+
+                                db << delete_query.str() << relative_path.generic_string() << static_cast<int>(downsample);
+                            }
+                            catch (const sqlite::sqlite_exception & exc)
+                            {
+                                BOOST_LOG_SEV(logger, severity_t::error) << exc.what() << endl << exc.get_code() << endl << exc.get_sql() << endl;
+                                continue;
+                            }
+                        }
+
                         if (need_recompute)
                         {
-                            BOOST_LOG_SEV(logger, severity_t::debug) << u8"Cannot find computed descriptor for: " << local_file << u8" when max_order = " << max_order << u8" Need recompute." << endl;
+                            BOOST_LOG_SEV(logger, severity_t::debug) << u8"Cannot find computed descriptors for: " << local_file << u8" for all orders " << order_list << u8" Need recompute." << endl;
                         }
                     }
                 }
@@ -136,15 +258,10 @@ void parallel::recursive_compute(const boost::filesystem::path & input_dir, int
                 }
                 else
                 {
-                    BOOST_LOG_SEV(logger, severity_t::info) << u8"File: " << local_file << u8" with hash: " << file_hash << u8" and max_order = " << max_order << u8" already exists. Skip" << endl;
+                    BOOST_LOG_SEV(logger, severity_t::info) << u8"File: " << local_file << u8" with hash: " << file_hash << u8" and orders " << order_list << u8" already exists. Skip" << endl;
                 }
             }
         }
-
-        while (!(all_voxel_paths.empty() || is_stop))
-        {
-            this_thread::sleep_for(500ms);
-        }
     }
 
     is_stop = true;
@@ -157,108 +274,449 @@ void parallel::recursive_compute(const boost::filesystem::path & input_dir, int
     BOOST_LOG_SEV(logger, severity_t::info) << u8"Completed" << endl;
 }
 
-void parallel::compute_descriptor(TasksQueue & queue, int max_order, std::atomic_bool & is_stop, sqlite::database & db)
+namespace
 {
-    using namespace std;
-    using namespace boost::filesystem;
-    using namespace logging;
+    // Worker loop. Geometrical moments are computed per file, the Zernike stage runs per batch of files.
+    template<typename ZernikeMomentsT>
+    void compute_descriptor_batches(parallel::TasksQueue & queue, const std::vector<int> & orders, std::size_t batch_size, parallel::VoxelInput voxel_input, ThreadPool & slab_pool, std::size_t slab_dim, std::size_t downsample, bool store_moments, std::atomic_bool & is_stop, sqlite::database & db)
+    {
+        using namespace std;
+        using namespace boost::filesystem;
+        using namespace logging;
+        using namespace parallel;
 
-    using VoxelType = bool;
-    using Container = vector<VoxelType>;
-    using DescriptorType = double;
+        using Descriptor = ZernikeDescriptor<DescriptorType, Container::iterator, ZernikeMomentsT>;
+        using Normalization = typename Descriptor::Normalization;
+        using CoarseDescriptor = ZernikeDescriptor<DescriptorType, CoarseContainer::iterator>;
 
-    Container binvox_voxels;
-    Container canonical_order_voxels;
-    size_t dim{};
+        // the descriptor of the highest order contains the invariants of all lower orders
+        const int max_order{ orders.back() };
 
-    logger_t & logger = logger_main::get();
+        // the level of VoxelPyramid which is box-filtered by downsample
+        int downsample_level{ 0 };
 
-    tuple<path, path, string> path_to_voxel;
+        while (VoxelPyramid<CoarseVoxelType>::GetFactor(downsample_level) < static_cast<int>(downsample))
+        {
+            downsample_level++;
+        }
 
-    using Row = sqldata::Row<DescriptorType>;
+        Container binvox_voxels;
+        Container canonical_order_voxels;
+        VoxelSegments segments;
+        BitVoxelGrid bits;
+        BrickVoxelGrid bricks;
+        size_t dim{};
+        binvox::GridDims dims;
 
-    const size_t rows_buffer_size{ 10 };
+        logger_t & logger = logger_main::get();
 
-    sqldata::CollectionRows < DescriptorType> rows;
+        tuple<path, path, string> path_to_voxel;
 
-    while (true)
-    {
-        if (!queue.pop(path_to_voxel))
+        const size_t rows_buffer_size{ 10 };
+
+        sqldata::CollectionRows < DescriptorType> rows;
+        vector<sqldata::MomentsRow<DescriptorType>> moments_rows;
+
+        // Descriptors waiting for the Zernike stage, their tasks and whether their moments were computed from the voxels
+        vector<Descriptor> batch;
+        vector<tuple<path, path, string>> batch_tasks;
+        vector<bool> batch_new_moments;
+
+        sqldata::MomentsRow<DescriptorType> stored;
+
+        // Small dense grids wait for the batch, the grids of the same dim are computed together, one per SIMD lane
+        struct LaneTask
+        {
+            size_t dim;
+            Container voxels;
+            tuple<path, path, string> task;
+        };
+
+        vector<LaneTask> lane_tasks;
+        const size_t lane_count{ Descriptor::LaneCount() };
+
+        batch.reserve(batch_size);
+        batch_tasks.reserve(batch_size);
+
+        // Moves the lane tasks into the batch: full lane groups with ComputeLanes(), the rest one by one
+        auto compute_lanes = [&]()
         {
-            if (is_stop)
+            stable_sort(lane_tasks.begin(), lane_tasks.end(), [](const LaneTask & a, const LaneTask & b) { return a.dim < b.dim; });
+
+            for (size_t begin{ 0 }, end{ 0 }; begin < lane_tasks.size(); begin = end)
             {
-                break;
+                const size_t group_dim{ lane_tasks[begin].dim };
+
+                while (end < lane_tasks.size() && lane_tasks[end].dim == group_dim)
+                {
+                    end++;
+                }
+
+                const size_t full{ (end - begin) / lane_count * lane_count };
+
+                if (full > 0)
+                {
+                    vector<Container::iterator> voxels;
+
+                    for (size_t k{ begin }; k < begin + full; k++)
+                    {
+                        voxels.push_back(lane_tasks[k].voxels.begin());
+                    }
+
+                    vector<Descriptor> descriptors = Descriptor::ComputeLanes(voxels.data(), voxels.size(), group_dim, max_order, true);
+
+                    for (size_t k{ 0 }; k < full; k++)
+                    {
+                        batch.push_back(move(descriptors[k]));
+                    }
+                }
+
+                for (size_t k{ begin + full }; k < end; k++)
+                {
+                    // This invoke changes voxels data
+                    batch.emplace_back(lane_tasks[k].voxels.begin(), group_dim, max_order, true);
+                }
+
+                for (size_t k{ begin }; k < end; k++)
+                {
+                    batch_tasks.push_back(lane_tasks[k].task);
+                    batch_new_moments.push_back(true);
+                }
             }
 
-            std::this_thread::sleep_for(50ms);
-        }
-        else
+            lane_tasks.clear();
+        };
+
+        auto save_rows = [&]() -> bool
         {
-            path absolute_path = get<0>(path_to_voxel) / get<1>(path_to_voxel);
+            // the rows of all orders and the moments are written in one transaction
+            lock_guard<mutex> lock{ db_write_mutex };
 
-            BOOST_LOG_SEV(logger, severity_t::debug) << u8"Processing " << absolute_path << endl;
+            try
+            {
+                db << u8"BEGIN;";
+                db << rows;
+
+                for (const auto & moments_row : moments_rows)
+                {
+                    db << moments_row;
+                }
 
-            if (!io::binvox::read_binvox(absolute_path, binvox_voxels, dim))
+                db << u8"COMMIT;";
+
+                BOOST_LOG_SEV(logger, severity_t::info) << u8"Save invariants to database." << endl;
+            }
+            catch (const sqlite::sqlite_exception & exc)
             {
-                BOOST_LOG_SEV(logger, severity_t::warning) << u8"Cannot read binvox from " << absolute_path << endl;
+                try
+                {
+                    db << u8"ROLLBACK;";
+                }
+                catch (const sqlite::sqlite_exception &)
+                {
+                    // the transaction was not started or is already rolled back
+                }
+
+                BOOST_LOG_SEV(logger, severity_t::warning) << u8"Cannot save invariants to database." << exc.what() << endl << exc.get_extended_code() << endl << exc.get_sql() << endl;
+                is_stop = true;
+                return false;
             }
-            else
+
+            rows.clear();
+            moments_rows.clear();
+
+            return true;
+        };
+
+        auto compute_batch = [&]() -> bool
+        {
+            compute_lanes();
+
+            if (batch.empty())
             {
-                canonical_order_voxels.resize(binvox_voxels.size());
-                binvox::utils::convert_to_canonical_order(binvox_voxels.begin(), canonical_order_voxels.begin(), dim);
+                return true;
+            }
+
+            vector<Descriptor *> descriptors;
 
-                // compute the zernike descriptors
-                // This invoke changes voxels data
-                ZernikeDescriptor<DescriptorType, Container::iterator> zd(canonical_order_voxels.begin(), dim, max_order);
+            for (auto & descriptor : batch)
+            {
+                descriptors.push_back(&descriptor);
+            }
 
-                auto invs{ zd.get_invariants() };
+            Descriptor::ComputeBatch(descriptors.data(), descriptors.size());
+
+            for (size_t i{ 0 }; i < batch.size(); i++)
+            {
+                if (rows.size() >= rows_buffer_size && !save_rows())
+                {
+                    return false;
+                }
 
-                if (rows.size() < rows_buffer_size)
+                // the invariants of a lower order are a prefix of the invariants of the highest order
+                for (int order : orders)
                 {
                     rows.emplace_row(
-                        get<1>(path_to_voxel).generic_string(),
-                        get<2>(path_to_voxel),
-                        invs,
-                        max_order);
+                        get<1>(batch_tasks[i]).generic_string(),
+                        get<2>(batch_tasks[i]),
+                        batch[i].get_invariants(order),
+                        order,
+                        static_cast<int>(downsample));
                 }
-                else
+
+                Normalization normalization{ batch[i].GetNormalization() };
+
+                // the moments table has one dimension per grid
+                bool is_cubic{ normalization.xDim_ == normalization.yDim_ && normalization.xDim_ == normalization.zDim_ };
+
+                if (store_moments && batch_new_moments[i] && !is_cubic)
+                {
+                    BOOST_LOG_SEV(logger, severity_t::debug) << u8"Moments of the non-cubic grid " << get<1>(batch_tasks[i]) << u8" are not stored" << endl;
+                }
+
+                if (store_moments && batch_new_moments[i] && is_cubic)
+                {
+                    moments_rows.push_back(sqldata::MomentsRow<DescriptorType>{
+                        get<1>(batch_tasks[i]).generic_string(),
+                        get<2>(batch_tasks[i]),
+                        max_order,
+                        normalization.xDim_,
+                        normalization.zeroMoment_,
+                        normalization.xCOG_,
+                        normalization.yCOG_,
+                        normalization.zCOG_,
+                        normalization.scale_,
+                        batch[i].GetGeometricalMoments() });
+                }
+            }
+
+            batch.clear();
+            batch_tasks.clear();
+            batch_new_moments.clear();
+
+            return true;
+        };
+
+        // An incomplete batch waits this long for new tasks, e.g. while the next file is hashed, before it is computed
+        const chrono::seconds batch_idle_timeout{ 1 };
+        auto last_task_time = chrono::steady_clock::now();
+
+        while (true)
+        {
+            if (!queue.pop(path_to_voxel))
+            {
+                // An incomplete batch is computed when the scan is over or no task came for batch_idle_timeout
+                if ((is_stop || chrono::steady_clock::now() - last_task_time >= batch_idle_timeout) && !compute_batch())
+                {
+                    return;
+                }
+
+                if (is_stop)
+                {
+                    break;
+                }
+
+                std::this_thread::sleep_for(50ms);
+            }
+            else
+            {
+                last_task_time = chrono::steady_clock::now();
+
+                path absolute_path = get<0>(path_to_voxel) / get<1>(path_to_voxel);
+
+                BOOST_LOG_SEV(logger, severity_t::debug) << u8"Processing " << absolute_path << endl;
+
+                // moments of an earlier run with the same file, the ones of the full grid do not serve a downsampled grid
+                bool is_stored{ false };
+
+                if (downsample == 1)
                 {
                     try
                     {
-                        db << rows;
-                        BOOST_LOG_SEV(logger, severity_t::info) << u8"Save invariants to database." << endl;
+                        lock_guard<mutex> lock{ db_write_mutex };
+
+                        is_stored = sqldata::select_moments(db, get<1>(path_to_voxel).generic_string(), get<2>(path_to_voxel), stored);
                     }
                     catch (const sqlite::sqlite_exception & exc)
                     {
-                        BOOST_LOG_SEV(logger, severity_t::warning) << u8"Cannot save invariants to database." << exc.what() << endl << exc.get_extended_code() << endl << exc.get_sql() << endl;
-                        is_stop = true;
+                        BOOST_LOG_SEV(logger, severity_t::warning) << u8"Cannot read stored moments." << exc.what() << endl << exc.get_extended_code() << endl << exc.get_sql() << endl;
+                    }
+                }
+
+                Normalization normalization{};
+
+                if (is_stored)
+                {
+                    normalization = Normalization{ stored.dim, stored.dim, stored.dim, stored.zero_moment, stored.x_cog, stored.y_cog, stored.z_cog, stored.scale };
+                }
+
+                if (is_stored && stored.max_order >= max_order)
+                {
+                    BOOST_LOG_SEV(logger, severity_t::debug) << u8"Use stored moments of order " << stored.max_order << u8" for " << absolute_path << endl;
+
+                    batch.emplace_back(stored.moments, normalization, max_order, true);
+                    batch_tasks.push_back(path_to_voxel);
+                    batch_new_moments.push_back(false);
+
+                    if (batch.size() + lane_tasks.size() >= batch_size && !compute_batch())
+                    {
                         return;
                     }
 
-                    rows.clear();
-                    rows.emplace_row(
-                        get<1>(path_to_voxel).generic_string(),
-                        get<2>(path_to_voxel),
-                        invs,
-                        max_order);
+                    continue;
+                }
+
+                // the normalization of lower stored orders saves the first pass over the grid
+                const Normalization * known_normalization{ is_stored ? &normalization : nullptr };
+
+                bool is_read{ false };
+
+                switch (voxel_input)
+                {
+                case VoxelInput::stream:
+                    // the file is read by the descriptor
+                    is_read = true;
+                    break;
+                case VoxelInput::runs:
+                    is_read = io::binvox::read_binvox(absolute_path, segments, dim);
+                    break;
+                case VoxelInput::bits:
+                    is_read = io::binvox::read_binvox(absolute_path, bits, dim);
+                    break;
+                case VoxelInput::bricks:
+                    is_read = io::binvox::read_binvox(absolute_path, bricks, dim);
+                    break;
+                default:
+                    // dense grids may have unequal dimensions
+                    is_read = io::binvox::read_binvox(absolute_path, binvox_voxels, dims);
+                    break;
+                }
+
+                if (!is_read)
+                {
+                    BOOST_LOG_SEV(logger, severity_t::warning) << u8"Cannot read binvox from " << absolute_path << endl;
+                }
+                else
+                {
+                    // compute the geometrical moments, the Zernike moments are computed for the whole batch
+                    if (voxel_input == VoxelInput::runs)
+                    {
+                        batch.emplace_back(segments, max_order, true, known_normalization);
+                    }
+                    else if (voxel_input == VoxelInput::stream)
+                    {
+                        VoxelSegmentsReader reader = [&absolute_path](const std::function<void(const VoxelSegments &)> & on_plane)
+                        {
+                            size_t stream_dim{};
+
+                            if (!io::binvox::read_binvox_planes(absolute_path, stream_dim, on_plane))
+                            {
+                                throw runtime_error(u8"Cannot read binvox from " + absolute_path.string());
+                            }
+                        };
+
+                        try
+                        {
+                            batch.emplace_back(reader, max_order, true, known_normalization);
+                        }
+                        catch (const runtime_error & exc)
+                        {
+                            BOOST_LOG_SEV(logger, severity_t::warning) << exc.what() << endl;
+                            continue;
+                        }
+                    }
+                    else if (voxel_input == VoxelInput::bits)
+                    {
+                        // This invoke changes voxels data
+                        batch.emplace_back(bits, max_order, true, known_normalization);
+                    }
+                    else if (voxel_input == VoxelInput::bricks)
+                    {
+                        // This invoke changes voxels data
+                        batch.emplace_back(bricks, max_order, true, known_normalization);
+                    }
+                    else
+                    {
+                        canonical_order_voxels.resize(binvox_voxels.size());
+                        binvox::utils::convert_to_canonical_order(binvox_voxels.begin(), canonical_order_voxels.begin(), dims);
+
+                        if (downsample > 1)
+                        {
+                            VoxelPyramid<CoarseVoxelType> pyramid(canonical_order_voxels.begin(), static_cast<int>(dims.x), static_cast<int>(dims.y), static_cast<int>(dims.z), downsample_level);
+                            int x_dim{}, y_dim{}, z_dim{};
+
+                            pyramid.GetDims(downsample_level, x_dim, y_dim, z_dim);
+
+                            ThreadPool * pool{ static_cast<size_t>(max({ x_dim, y_dim, z_dim })) >= slab_dim ? &slab_pool : nullptr };
+
+                            // The grid has fractional voxels, its moments and normalization are taken over by a descriptor of the batch. This invoke changes voxels data of the pyramid
+                            CoarseDescriptor coarse{ pyramid.GetVoxels(downsample_level).begin(), static_cast<size_t>(x_dim), static_cast<size_t>(y_dim), static_cast<size_t>(z_dim), static_cast<size_t>(max_order), true, GeometricalMomentsEngine::diff, pool, nullptr, true };
+                            typename CoarseDescriptor::Normalization coarse_normalization{ coarse.GetNormalization() };
+
+                            batch.emplace_back(coarse.GetGeometricalMoments(), Normalization{
+                                coarse_normalization.xDim_,
+                                coarse_normalization.yDim_,
+                                coarse_normalization.zDim_,
+                                coarse_normalization.zeroMoment_,
+                                coarse_normalization.xCOG_,
+                                coarse_normalization.yCOG_,
+                                coarse_normalization.zCOG_,
+                                coarse_normalization.scale_ }, max_order, true);
+                        }
+                        else
+                        {
+                            if (known_normalization == nullptr && dims.is_cubic() && dims.x <= lane_max_dim)
+                            {
+                                lane_tasks.push_back(LaneTask{ dims.x, canonical_order_voxels, path_to_voxel });
+
+                                if (batch.size() + lane_tasks.size() >= batch_size && !compute_batch())
+                                {
+                                    return;
+                                }
+
+                                continue;
+                            }
+
+                            // Large grids are split into slabs on all threads, the others are computed by this worker alone
+                            ThreadPool * pool{ max({ dims.x, dims.y, dims.z }) >= slab_dim ? &slab_pool : nullptr };
+
+                            // This invoke changes voxels data
+                            batch.emplace_back(canonical_order_voxels.begin(), dims.x, dims.y, dims.z, max_order, true, GeometricalMomentsEngine::diff, pool, known_normalization);
+                        }
+                    }
+
+                    batch_tasks.push_back(path_to_voxel);
+                    // the moments of a downsampled grid do not belong to the file
+                    batch_new_moments.push_back(downsample == 1);
+
+                    if (batch.size() + lane_tasks.size() >= batch_size && !compute_batch())
+                    {
+                        return;
+                    }
                 }
             }
         }
-    }
 
-    // Rest items
-    if (!rows.empty())
-    {
-        try
+        // Rest items
+        if (!rows.empty())
         {
-            db << rows;
-            BOOST_LOG_SEV(logger, severity_t::info) << u8"Save invariants to database." << endl;
-        }
-        catch (const sqlite::sqlite_exception & exc)
-        {
-            BOOST_LOG_SEV(logger, severity_t::warning) << u8"Cannot save invariants to database." << exc.what() << endl << exc.get_extended_code() << endl << exc.get_sql() << endl;
-            is_stop = true;
-            return;
+            save_rows();
         }
     }
+}
+
+void parallel::compute_descriptor(TasksQueue & queue, const std::vector<int> & orders, std::size_t batch_size, VoxelInput voxel_input, ThreadPool & slab_pool, std::size_t slab_dim, std::size_t downsample, bool store_moments, std::atomic_bool & is_stop, sqlite::database & db)
+{
+    // Orders with compile-time coefficient tables use them
+    bool is_fixed_order = VisitFixedZernikeOrder(orders.back(), [&](auto order)
+    {
+        using FixedMomentsT = FixedZernikeMoments<decltype(order)::value, Container::iterator, DescriptorType>;
+
+        compute_descriptor_batches<FixedMomentsT>(queue, orders, batch_size, voxel_input, slab_pool, slab_dim, downsample, store_moments, is_stop, db);
+    });
+
+    if (!is_fixed_order)
+    {
+        compute_descriptor_batches<ZernikeMoments<Container::iterator, DescriptorType>>(queue, orders, batch_size, voxel_input, slab_pool, slab_dim, downsample, store_moments, is_stop, db);
+    }
 }
\ No newline at end of file
@@ -44,8 +44,10 @@ for more information, see the paper:
     3D Zernike descriptors from a given input binary file containing the
     voxel grid representation of the object.
 
-    Notice that in the below case, the file contains a cubic grid, i.e. the
-    x-, y-, and z-dimensions are equal (such setting should satisfy most needs).
+    Notice that the grids read as runs, bits, stream or bricks must be cubic, i.e. the
+    x-, y-, and z-dimensions are equal. Dense grids may have any dimensions,
+    with --downsample they are box-filtered into coarser grids of fractional
+    occupancy first.
 */
 
 #include "stdafx.h"
@@ -66,6 +68,13 @@ namespace cliargs
     constexpr const char * log_sett_short_arh_name{ u8"l" };
     constexpr const char * db_arg_name{ u8"output-db" };
     constexpr const char * db_short_arg_name{ u8"o" };
+    constexpr const char * basis_arg_name{ u8"basis-file" };
+    constexpr const char * basis_short_arg_name{ u8"b" };
+    constexpr const char * batch_arg_name{ u8"batch-size" };
+    constexpr const char * voxels_arg_name{ u8"voxels" };
+    constexpr const char * slab_dim_arg_name{ u8"slab-dim" };
+    constexpr const char * store_moments_arg_name{ u8"store-moments" };
+    constexpr const char * downsample_arg_name{ u8"downsample" };
 }
 
 bool init_logg_settings_from_file(const boost::filesystem::path & path_to_config)
@@ -132,15 +141,35 @@ auto parse_cli_args(int argc, char ** argv)
     db_arg += ',';
     db_arg += db_short_arg_name;
 
+    string batch_arg{ batch_arg_name };
+
+    string voxels_arg{ voxels_arg_name };
+
+    string slab_dim_arg{ slab_dim_arg_name };
+
+    string store_moments_arg{ store_moments_arg_name };
+
+    string downsample_arg{ downsample_arg_name };
+
+    string basis_arg{ basis_arg_name };
+    basis_arg += ',';
+    basis_arg += basis_short_arg_name;
+
     options_description desc{ u8"Program options for descriptors. Create XML file with descriptors for each binvox in input directory.\nSee: Novotni M., Klein R. 3D zernike descriptors for content based shape retrieval New York, New York, USA: ACM Press, 2003. 216 c." };
     desc.add_options()
-        (u8"help,h", u8"-d path_to_directory -n max_order")
+        (u8"help,h", u8"-d path_to_directory -n max_order [order ...]")
         (dir.c_str(), value<string>(), u8"Path to directory with .binvox files.")
-        (order.c_str(), value<int>(), u8"Maximum order of Zernike moments. N in original paper.")
+        (order.c_str(), value<vector<int>>()->multitoken(), u8"Maximum order of Zernike moments. N in original paper. Several orders, e.g. -n 10 16 20, are computed in one pass from the moments of the highest order.")
         (thread_arg.c_str(), value<int>()->default_value(2), u8"Maximum number of threads for descriptor computing.")
         (queue_arg.c_str(), value<int>()->default_value(500), u8"Maximum size of queue of file paths when recursive scanning directory. If size of queue is greater than parameter then scanning thread sleeps.")
         (log_arg.c_str(), value<string>()->default_value(u8"logsettings.ini"), u8"Path to file with log config. See https://www.boost.org/doc/libs/1_72_0/libs/log/doc/html/log/detailed/utilities.html#log.detailed.utilities.setup.settings_file")
         (db_arg.c_str(), value<string>()->default_value(u8"descriptors.sqlite"), u8"Path to database to store descriptors")
+        (batch_arg.c_str(), value<int>()->default_value(8), u8"Number of files per worker thread which Zernike moments are computed in one pass over the basis.")
+        (basis_arg.c_str(), value<string>(), u8"Path to file with precomputed Zernike basis. The file is memory-mapped if it matches max order, otherwise the basis is computed and saved to it.")
+        (voxels_arg.c_str(), value<string>()->default_value(u8"dense"), u8"How voxels are read: 'dense' expands the grid, 'runs' computes moments from run-length encoded data of binvox, 'bits' packs the grid into 64-bit words, 'stream' reads the file twice plane by plane without keeping the grid in memory, 'bricks' keeps sparse bricks of 8^3 voxels. 'runs' is faster for sparse models, 'stream' and 'bricks' are for grids which do not fit into memory.")
+        (slab_dim_arg.c_str(), value<int>()->default_value(256), u8"Dense grids with at least this dimension are split into z-slabs which are computed on all threads. Smaller grids are computed by one thread per file.")
+        (store_moments_arg.c_str(), bool_switch(), u8"Save the geometrical moments of every computed file to the database. Later runs with the same or a lower max order compute the descriptors from them without reading the files, runs with a higher order reuse the center of gravity and the scale.")
+        (downsample_arg.c_str(), value<int>()->default_value(1), u8"Box-filter dense grids by 2, 4 or 8 along every axis into grids of fractional occupancy before the descriptors are computed. The descriptors approximate the ones of the full grid at 1/8, 1/64 or 1/512 of the voxels, see tools/downsample_report. The rows record the factor, so the descriptors of several factors share a database.")
         ;
 
     variables_map vm;
@@ -183,12 +212,13 @@ bool validate_args(const boost::program_options::variables_map & args, const boo
     }
 
     {
-        int max_order{ args[order_arg_name].as<int>() };
-
-        if (max_order <= 0)
+        for (int max_order : args[order_arg_name].as<vector<int>>())
         {
-            cerr << u8"Maximum order must be positive. Actual value is " << max_order << endl;
-            return false;
+            if (max_order <= 0)
+            {
+                cerr << u8"Maximum order must be positive. Actual value is " << max_order << endl;
+                return false;
+            }
         }
     }
 
@@ -212,6 +242,26 @@ bool validate_args(const boost::program_options::variables_map & args, const boo
         }
     }
 
+    {
+        int slab_dim{ args[slab_dim_arg_name].as<int>() };
+
+        if (slab_dim <= 0)
+        {
+            cerr << u8"Slab dimension must be positive. Actual value is " << slab_dim << endl;
+            return false;
+        }
+    }
+
+    {
+        int batch_size{ args[batch_arg_name].as<int>() };
+
+        if (batch_size <= 0)
+        {
+            cerr << u8"Batch size must be positive. Actual value is " << batch_size << endl;
+            return false;
+        }
+    }
+
     {
         path log_sett{ args[log_sett_arg_name].as<string>() };
 
@@ -235,6 +285,49 @@ bool validate_args(const boost::program_options::variables_map & args, const boo
         }
     }
 
+    {
+        string voxels{ args[voxels_arg_name].as<string>() };
+
+        if (voxels != u8"dense" && voxels != u8"runs" && voxels != u8"bits" && voxels != u8"stream" && voxels != u8"bricks")
+        {
+            cerr << voxels_arg_name << u8" must be 'dense', 'runs', 'bits', 'stream' or 'bricks'. Actual value is " << voxels << endl;
+            return false;
+        }
+    }
+
+    {
+        int downsample{ args[downsample_arg_name].as<int>() };
+
+        if (downsample != 1 && downsample != 2 && downsample != 4 && downsample != 8)
+        {
+            cerr << downsample_arg_name << u8" must be 1, 2, 4 or 8. Actual value is " << downsample << endl;
+            return false;
+        }
+
+        if (downsample > 1 && args[voxels_arg_name].as<string>() != u8"dense")
+        {
+            cerr << downsample_arg_name << u8" requires dense voxels." << endl;
+            return false;
+        }
+
+        if (downsample > 1 && args[store_moments_arg_name].as<bool>())
+        {
+            cerr << downsample_arg_name << u8" cannot be combined with " << store_moments_arg_name << u8", the moments of the downsampled grids do not belong to the files." << endl;
+            return false;
+        }
+    }
+
+    if (args.count(basis_arg_name))
+    {
+        path basis_file{ args[basis_arg_name].as<string>() };
+
+        if (exists(basis_file) && status(basis_file).type() != file_type::regular_file)
+        {
+            cerr << basis_file << u8" is not file." << endl;
+            return false;
+        }
+    }
+
     return true;
 }
 
@@ -285,10 +378,41 @@ int main(int argc, char ** argv)
     }
 
     path input_directory{ args[dir_arg_name].as<string>() };
-    int max_order{ args[order_arg_name].as<int>() };
+    vector<int> orders{ args[order_arg_name].as<vector<int>>() };
     int queue_size{ args[queue_arg_name].as<int>() };
     int thread_count{ args[thread_arg_name].as<int>() };
+    int batch_size{ args[batch_arg_name].as<int>() };
+    int slab_dim{ args[slab_dim_arg_name].as<int>() };
+    bool store_moments{ args[store_moments_arg_name].as<bool>() };
+    int downsample{ args[downsample_arg_name].as<int>() };
+    parallel::VoxelInput voxel_input{ parallel::VoxelInput::dense };
+
+    sort(orders.begin(), orders.end());
+    orders.erase(unique(orders.begin(), orders.end()), orders.end());
+
+    if (args[voxels_arg_name].as<string>() == u8"runs")
+    {
+        voxel_input = parallel::VoxelInput::runs;
+    }
+    else if (args[voxels_arg_name].as<string>() == u8"bits")
+    {
+        voxel_input = parallel::VoxelInput::bits;
+    }
+    else if (args[voxels_arg_name].as<string>() == u8"stream")
+    {
+        voxel_input = parallel::VoxelInput::stream;
+    }
+    else if (args[voxels_arg_name].as<string>() == u8"bricks")
+    {
+        voxel_input = parallel::VoxelInput::bricks;
+    }
     path db_path{ args[db_arg_name].as<string>() };
+    path basis_file;
+
+    if (args.count(basis_arg_name))
+    {
+        basis_file = args[basis_arg_name].as<string>();
+    }
 
     logging::logger_t & logger = logging::logger_main::get();
 
@@ -302,8 +426,9 @@ int main(int argc, char ** argv)
         sqlite::database db(db_path.string(), config);
 
         db::DbSchema::init_db(db);
+        db::MomentsSchema::init_db(db);
 
-        parallel::recursive_compute(input_directory, max_order, queue_size, thread_count, db);
+        parallel::recursive_compute(input_directory, orders, queue_size, thread_count, batch_size, voxel_input, slab_dim, downsample, store_moments, basis_file, db);
 
         clear();
     }
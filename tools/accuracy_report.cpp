@@ -0,0 +1,212 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+// Compares the invariants of the float path with the double path for every engine and SIMD level.
+// Usage: accuracy_report [order] [dimension ...]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "ZernikeDescriptor.hpp"
+
+namespace
+{
+    using VoxelIterator = std::vector<bool>::iterator;
+
+    template<class T>
+    using DescriptorT = ZernikeDescriptor<T, VoxelIterator>;
+
+    /// A ball with a hole, so all moments are nonzero
+    std::vector<bool> make_grid(int dim)
+    {
+        std::vector<bool> grid(static_cast<std::size_t>(dim) * dim * dim);
+        double center = dim / 2.0, radius = dim * 0.4;
+
+        for (int z = 0; z < dim; z++)
+        {
+            for (int y = 0; y < dim; y++)
+            {
+                for (int x = 0; x < dim; x++)
+                {
+                    double dx = x - center, dy = y - center * 0.9, dz = z - center * 1.1;
+                    double r2 = dx * dx + dy * dy + dz * dz;
+                    grid[(static_cast<std::size_t>(z) * dim + y) * dim + x] = r2 < radius * radius && (x < center || y < center);
+                }
+            }
+        }
+
+        return grid;
+    }
+
+    template<class T>
+    double measure(std::vector<bool> & grid, int dim, int order, GeometricalMomentsEngine engine, std::vector<double> & invariants)
+    {
+        using clock = std::chrono::steady_clock;
+
+        double best{ 0 };
+
+        for (int run = 0; run < 3; run++)
+        {
+            auto start = clock::now();
+            DescriptorT<T> descriptor(grid.begin(), dim, order, false, engine);
+            double seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+            best = run == 0 ? seconds : std::min(best, seconds);
+
+            const auto & values = descriptor.get_invariants();
+            invariants.assign(values.begin(), values.end());
+        }
+
+        return best;
+    }
+
+    const char * engine_name(GeometricalMomentsEngine engine)
+    {
+        switch (engine)
+        {
+        case GeometricalMomentsEngine::contraction:
+            return u8"contraction";
+        case GeometricalMomentsEngine::sparseDiff:
+            return u8"sparse diff";
+        default:
+            return u8"diff";
+        }
+    }
+
+    /// Order n of every invariant, they are stored by n and l, n - l even
+    std::vector<int> invariant_orders(int order)
+    {
+        std::vector<int> orders;
+
+        for (int n = 0; n <= order; n++)
+        {
+            orders.insert(orders.end(), n / 2 + 1, n);
+        }
+
+        return orders;
+    }
+
+    struct Config
+    {
+        GeometricalMomentsEngine engine;
+        SimdLevel simd;
+    };
+
+    void run(std::vector<bool> & grid, int dim, int order)
+    {
+        std::vector<double> reference, invariants;
+        std::vector<int> orders = invariant_orders(order);
+
+        // the double reference is the scalar diff engine
+        SelectSimdLevel(SimdLevel::scalar);
+        double double_time = measure<double>(grid, dim, order, GeometricalMomentsEngine::diff, reference);
+
+        std::vector<Config> configs;
+
+        for (int level = 0; level <= static_cast<int>(DetectSimdLevel()); level++)
+        {
+            configs.push_back(Config{ GeometricalMomentsEngine::diff, static_cast<SimdLevel>(level) });
+        }
+
+        configs.push_back(Config{ GeometricalMomentsEngine::contraction, DetectSimdLevel() });
+        configs.push_back(Config{ GeometricalMomentsEngine::sparseDiff, DetectSimdLevel() });
+
+        std::vector<double> order_deviations(order + 1, 0.0);
+
+        // invariants below 1e-3 of the largest one, e.g. n = 1 which vanishes after the centering, are compared with that bound
+        double min_magnitude{ 0 };
+
+        for (double value : reference)
+        {
+            min_magnitude = std::max(min_magnitude, std::abs(value) * 1e-3);
+        }
+
+        for (const Config & config : configs)
+        {
+            bool simd_engine = config.engine == GeometricalMomentsEngine::diff;
+            SimdLevel simd = SelectSimdLevel(config.simd);
+            double time = measure<float>(grid, dim, order, config.engine, invariants);
+
+            double max_deviation{ 0 }, sum_deviation{ 0 };
+            int worst_order{ 0 };
+
+            for (std::size_t i{ 0 }; i < invariants.size(); i++)
+            {
+                double deviation = std::abs(invariants[i] - reference[i]) / std::max(std::abs(reference[i]), min_magnitude);
+
+                if (deviation > max_deviation)
+                {
+                    max_deviation = deviation;
+                    worst_order = orders[i];
+                }
+
+                sum_deviation += deviation;
+
+                if (simd == DetectSimdLevel() && simd_engine)
+                {
+                    order_deviations[orders[i]] = std::max(order_deviations[orders[i]], deviation);
+                }
+            }
+
+            std::cout << std::setw(6) << dim << std::setw(13) << engine_name(config.engine)
+                << std::setw(8) << (simd_engine ? GetSimdLevelName(simd) : u8"-")
+                << std::setw(12) << std::fixed << std::setprecision(2) << time * 1000.0
+                << std::setw(10) << std::setprecision(2) << double_time / time
+                << std::setw(14) << std::scientific << std::setprecision(2) << max_deviation
+                << std::setw(6) << worst_order
+                << std::setw(14) << sum_deviation / invariants.size() << std::endl;
+        }
+
+        std::cout << u8"  max rel deviation per order n (diff, " << GetSimdLevelName(DetectSimdLevel()) << u8"):";
+
+        for (int n = 0; n <= order; n++)
+        {
+            std::cout << (n % 5 == 0 ? u8"\n   " : u8"") << std::setw(4) << n << u8": "
+                << std::scientific << std::setprecision(2) << order_deviations[n];
+        }
+
+        std::cout << std::endl;
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    int order{ argc > 1 ? std::atoi(argv[1]) : 20 };
+    std::vector<int> dims;
+
+    for (int i = 2; i < argc; i++)
+    {
+        dims.push_back(std::atoi(argv[i]));
+    }
+
+    if (dims.empty())
+    {
+        dims = { 32, 64, 128 };
+    }
+
+    if (order <= 0 || std::any_of(dims.begin(), dims.end(), [](int dim) { return dim <= 0; }))
+    {
+        std::cerr << u8"Usage: " << argv[0] << u8" [order] [dimension ...]" << std::endl;
+        return 1;
+    }
+
+    std::cout << u8"order " << order << u8", detected " << GetSimdLevelName(DetectSimdLevel())
+        << u8", float invariants against the double invariants of the scalar diff engine" << std::endl;
+    std::cout << std::setw(6) << u8"dim" << std::setw(13) << u8"engine" << std::setw(8) << u8"simd"
+        << std::setw(12) << u8"time, ms" << std::setw(10) << u8"speedup" << std::setw(14) << u8"max rel dev"
+        << std::setw(6) << u8"at n" << std::setw(14) << u8"mean rel dev" << std::endl;
+
+    for (int dim : dims)
+    {
+        std::vector<bool> grid = make_grid(dim);
+
+        run(grid, dim, order);
+    }
+
+    return 0;
+}
@@ -0,0 +1,202 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+// Measures ScaledGeometricalMoments with every engine and every SIMD level supported by the CPU.
+// Usage: benchmark_moments [order] [dimension ...]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "ScaledGeometricMoments.hpp"
+
+namespace
+{
+    using VoxelIterator = std::vector<bool>::const_iterator;
+
+    template<class T>
+    using MomentsT = ScaledGeometricalMoments<VoxelIterator, T>;
+
+    /// A ball with a hole, so all moments are nonzero
+    std::vector<bool> make_grid(int dim)
+    {
+        std::vector<bool> grid(static_cast<std::size_t>(dim) * dim * dim);
+        double center = dim / 2.0, radius = dim * 0.4;
+
+        for (int z = 0; z < dim; z++)
+        {
+            for (int y = 0; y < dim; y++)
+            {
+                for (int x = 0; x < dim; x++)
+                {
+                    double dx = x - center, dy = y - center * 0.9, dz = z - center * 1.1;
+                    double r2 = dx * dx + dy * dy + dz * dz;
+                    grid[(static_cast<std::size_t>(z) * dim + y) * dim + x] = r2 < radius * radius && (x < center || y < center);
+                }
+            }
+        }
+
+        return grid;
+    }
+
+    template<class T>
+    double measure(const std::vector<bool> & grid, int dim, int order, GeometricalMomentsEngine engine, std::vector<T> & moments)
+    {
+        using clock = std::chrono::steady_clock;
+
+        double best{ 0 };
+
+        for (int run = 0; run < 3; run++)
+        {
+            auto start = clock::now();
+            MomentsT<T> gm(grid.begin(), dim, dim, dim, dim / 2.0, dim / 2.0, dim / 2.0, 1.0 / dim, order, engine);
+            double seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+            best = run == 0 ? seconds : std::min(best, seconds);
+            moments = gm.GetMoments();
+        }
+
+        return best;
+    }
+
+    struct Config
+    {
+        GeometricalMomentsEngine engine;
+        SimdLevel simd;
+    };
+
+    const char * engine_name(GeometricalMomentsEngine engine)
+    {
+        switch (engine)
+        {
+        case GeometricalMomentsEngine::contraction:
+            return u8"contraction";
+        case GeometricalMomentsEngine::sparseDiff:
+            return u8"sparse diff";
+        default:
+            return u8"diff";
+        }
+    }
+
+    /**
+     * Relative error of every moment against the exact ones. The moments of order n
+     * scale with (1/2)^n, so a moment below 1e-3 of the largest one of its order,
+     * e.g. an odd moment which nearly cancels, is compared with that bound.
+     */
+    template<class T>
+    double max_relative_error(const std::vector<T> & moments, const std::vector<double> & exact, int order, int & worst_order)
+    {
+        double max_error{ 0 };
+
+        worst_order = 0;
+
+        for (int n = 0; n <= order; n++)
+        {
+            std::size_t begin{ n > 0 ? GeometricalMomentCount(n - 1) : 0 }, end{ GeometricalMomentCount(n) };
+            double min_magnitude{ 0 };
+
+            for (std::size_t i{ begin }; i < end; i++)
+            {
+                min_magnitude = std::max(min_magnitude, std::abs(exact[i]) * 1e-3);
+            }
+
+            for (std::size_t i{ begin }; i < end; i++)
+            {
+                double error = std::abs(static_cast<double>(moments[i]) - exact[i]) / std::max(std::abs(exact[i]), min_magnitude);
+
+                if (error > max_error)
+                {
+                    max_error = error;
+                    worst_order = n;
+                }
+            }
+        }
+
+        return max_error;
+    }
+
+    template<class T>
+    void run(const char * type, const std::vector<bool> & grid, int dim, int order, const std::vector<double> & exact)
+    {
+        std::vector<T> moments;
+        double scalar_time{ 0 };
+
+        // the diff engine with every SIMD level, then the engines without SIMD kernels
+        std::vector<Config> configs;
+
+        for (int level = 0; level <= static_cast<int>(DetectSimdLevel()); level++)
+        {
+            configs.push_back(Config{ GeometricalMomentsEngine::diff, static_cast<SimdLevel>(level) });
+        }
+
+        configs.push_back(Config{ GeometricalMomentsEngine::contraction, DetectSimdLevel() });
+        configs.push_back(Config{ GeometricalMomentsEngine::sparseDiff, DetectSimdLevel() });
+
+        for (std::size_t c = 0; c < configs.size(); c++)
+        {
+            bool simd_engine = configs[c].engine == GeometricalMomentsEngine::diff;
+            SimdLevel simd = SelectSimdLevel(configs[c].simd);
+            double time = measure<T>(grid, dim, order, configs[c].engine, moments);
+
+            if (c == 0)
+            {
+                scalar_time = time;
+            }
+
+            int worst_order{ 0 };
+            double max_error = max_relative_error(moments, exact, order, worst_order);
+
+            std::cout << std::setw(6) << dim << std::setw(8) << type << std::setw(13) << engine_name(configs[c].engine)
+                << std::setw(8) << (simd_engine ? GetSimdLevelName(simd) : u8"-")
+                << std::setw(12) << std::fixed << std::setprecision(2) << time * 1000.0
+                << std::setw(10) << std::setprecision(2) << scalar_time / time
+                << std::setw(14) << std::scientific << std::setprecision(2) << max_error
+                << std::setw(6) << worst_order << std::endl;
+        }
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    int order{ argc > 1 ? std::atoi(argv[1]) : 20 };
+    std::vector<int> dims;
+
+    for (int i = 2; i < argc; i++)
+    {
+        dims.push_back(std::atoi(argv[i]));
+    }
+
+    if (dims.empty())
+    {
+        dims = { 32, 64, 128 };
+    }
+
+    if (order <= 0 || std::any_of(dims.begin(), dims.end(), [](int dim) { return dim <= 0; }))
+    {
+        std::cerr << u8"Usage: " << argv[0] << u8" [order] [dimension ...]" << std::endl;
+        return 1;
+    }
+
+    std::cout << u8"order " << order << u8", detected " << GetSimdLevelName(DetectSimdLevel())
+        << u8", moments against the double moments of the scalar diff engine" << std::endl;
+    std::cout << std::setw(6) << u8"dim" << std::setw(8) << u8"type" << std::setw(13) << u8"engine" << std::setw(8) << u8"simd"
+        << std::setw(12) << u8"time, ms" << std::setw(10) << u8"speedup" << std::setw(14) << u8"max rel err" << std::setw(6) << u8"at n" << std::endl;
+
+    for (int dim : dims)
+    {
+        std::vector<bool> grid = make_grid(dim);
+        std::vector<double> exact;
+
+        SelectSimdLevel(SimdLevel::scalar);
+        measure<double>(grid, dim, order, GeometricalMomentsEngine::diff, exact);
+
+        run<double>(u8"double", grid, dim, order, exact);
+        run<float>(u8"float", grid, dim, order, exact);
+    }
+
+    return 0;
+}
@@ -0,0 +1,204 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+// Compares the invariants of the downsampled grids of VoxelPyramid with the invariants of the full grid.
+// The tolerance bounds the distance of the descriptors relative to the norm of the full descriptor.
+// Usage: downsample_report [order] [tolerance] [dimension ...]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "VoxelPyramid.hpp"
+#include "ZernikeDescriptor.hpp"
+
+namespace
+{
+    using FullDescriptor = ZernikeDescriptor<double, std::vector<bool>::iterator>;
+    using CoarseDescriptor = ZernikeDescriptor<double, std::vector<float>::iterator>;
+    using Pyramid = VoxelPyramid<float>;
+
+    // the coarsest level of the report, 8x along every axis
+    constexpr int max_level{ 3 };
+
+    /// A ball with a hole and a thin plate, so the coarse levels lose details of several sizes
+    std::vector<bool> make_grid(int dim)
+    {
+        std::vector<bool> grid(static_cast<std::size_t>(dim) * dim * dim);
+        double center = dim / 2.0, radius = dim * 0.35;
+
+        for (int z = 0; z < dim; z++)
+        {
+            for (int y = 0; y < dim; y++)
+            {
+                for (int x = 0; x < dim; x++)
+                {
+                    double dx = x - center, dy = y - center * 0.9, dz = z - center * 1.1;
+                    double r2 = dx * dx + dy * dy + dz * dz;
+                    bool ball = r2 < radius * radius && (x < center || y < center);
+                    bool plate = std::abs(z - dim * 0.2) < dim / 64.0 + 1 && x > dim / 8 && x < dim * 7 / 8 && y > dim / 4;
+
+                    grid[(static_cast<std::size_t>(z) * dim + y) * dim + x] = ball || plate;
+                }
+            }
+        }
+
+        return grid;
+    }
+
+    /// Order n of every invariant, they are stored by n and l, n - l even
+    std::vector<int> invariant_orders(int order)
+    {
+        std::vector<int> orders;
+
+        for (int n = 0; n <= order; n++)
+        {
+            orders.insert(orders.end(), n / 2 + 1, n);
+        }
+
+        return orders;
+    }
+
+    /// Best time of 3 runs of compute(), which returns the invariants
+    template<class Compute>
+    double measure(Compute && compute, std::vector<double> & invariants)
+    {
+        using clock = std::chrono::steady_clock;
+
+        double best{ 0 };
+
+        for (int run = 0; run < 3; run++)
+        {
+            auto start = clock::now();
+            std::vector<double> values = compute();
+            double seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+            best = run == 0 ? seconds : std::min(best, seconds);
+            invariants = values;
+        }
+
+        return best;
+    }
+
+    void run(const std::vector<bool> & grid, int dim, int order, double tolerance)
+    {
+        std::vector<double> reference, invariants;
+        std::vector<int> orders = invariant_orders(order);
+
+        // the descriptors clear the voxels outside of the unit ball, so every run gets a copy of the grid
+        double full_time = measure([&]()
+        {
+            std::vector<bool> voxels(grid);
+            FullDescriptor descriptor(voxels.begin(), dim, order);
+
+            return descriptor.get_invariants();
+        }, reference);
+
+        // invariants below 1e-3 of the largest one, e.g. n = 1 which vanishes after the centering, are compared with that bound
+        double min_magnitude{ 0 };
+
+        for (double value : reference)
+        {
+            min_magnitude = std::max(min_magnitude, std::abs(value) * 1e-3);
+        }
+
+        std::cout << std::setw(6) << dim << std::setw(8) << 1 << std::setw(8) << dim
+            << std::setw(12) << std::fixed << std::setprecision(2) << full_time * 1000.0 << std::endl;
+
+        int best_factor{ 1 };
+
+        for (int level = 1; level <= max_level && dim >> level > 0; level++)
+        {
+            int coarse_dim{ 0 };
+
+            // the time includes the box filter of all levels up to this one
+            double time = measure([&]()
+            {
+                Pyramid pyramid(grid.begin(), dim, dim, dim, level);
+                int x_dim, y_dim, z_dim;
+
+                pyramid.GetDims(level, x_dim, y_dim, z_dim);
+                coarse_dim = x_dim;
+
+                CoarseDescriptor descriptor(pyramid.GetVoxels(level).begin(), x_dim, y_dim, z_dim, order,
+                    false, GeometricalMomentsEngine::diff, nullptr, nullptr, true);
+
+                return descriptor.get_invariants();
+            }, invariants);
+
+            double max_deviation{ 0 }, sqr_distance{ 0 }, sqr_norm{ 0 };
+            int worst_order{ 0 };
+
+            for (std::size_t i{ 0 }; i < invariants.size(); i++)
+            {
+                double deviation = std::abs(invariants[i] - reference[i]) / std::max(std::abs(reference[i]), min_magnitude);
+
+                if (deviation > max_deviation)
+                {
+                    max_deviation = deviation;
+                    worst_order = orders[i];
+                }
+
+                sqr_distance += (invariants[i] - reference[i]) * (invariants[i] - reference[i]);
+                sqr_norm += reference[i] * reference[i];
+            }
+
+            // the retrieval compares the distances of the descriptors, so the tolerance applies to the relative distance
+            double distance = std::sqrt(sqr_distance / sqr_norm);
+
+            // the levels are checked from fine to coarse, the first one above the tolerance ends the usable ones
+            if (distance <= tolerance && best_factor == Pyramid::GetFactor(level - 1))
+            {
+                best_factor = Pyramid::GetFactor(level);
+            }
+
+            std::cout << std::setw(6) << dim << std::setw(8) << Pyramid::GetFactor(level) << std::setw(8) << coarse_dim
+                << std::setw(12) << std::fixed << std::setprecision(2) << time * 1000.0
+                << std::setw(10) << std::setprecision(1) << full_time / time
+                << std::setw(14) << std::scientific << std::setprecision(2) << distance
+                << std::setw(14) << max_deviation
+                << std::setw(6) << worst_order << std::endl;
+        }
+
+        std::cout << u8"  coarsest factor within " << std::scientific << std::setprecision(2) << tolerance << u8": " << best_factor << std::endl;
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    int order{ argc > 1 ? std::atoi(argv[1]) : 20 };
+    double tolerance{ argc > 2 ? std::atof(argv[2]) : 1e-2 };
+    std::vector<int> dims;
+
+    for (int i = 3; i < argc; i++)
+    {
+        dims.push_back(std::atoi(argv[i]));
+    }
+
+    if (dims.empty())
+    {
+        dims = { 64, 128, 256 };
+    }
+
+    if (order <= 0 || tolerance <= 0 || std::any_of(dims.begin(), dims.end(), [](int dim) { return dim <= 0; }))
+    {
+        std::cerr << u8"Usage: " << argv[0] << u8" [order] [tolerance] [dimension ...]" << std::endl;
+        return 1;
+    }
+
+    std::cout << u8"order " << order << u8", invariants of the box-filtered grids against the ones of the full grid" << std::endl;
+    std::cout << std::setw(6) << u8"dim" << std::setw(8) << u8"factor" << std::setw(8) << u8"coarse"
+        << std::setw(12) << u8"time, ms" << std::setw(10) << u8"speedup" << std::setw(14) << u8"rel distance"
+        << std::setw(14) << u8"max rel dev" << std::setw(6) << u8"at n" << std::endl;
+
+    for (int dim : dims)
+    {
+        run(make_grid(dim), dim, order, tolerance);
+    }
+
+    return 0;
+}
@@ -0,0 +1,135 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+// Emits a header with the specialization FixedZernikeBasis<N> (see FixedZernikeMoments.hpp).
+// Usage: generate_fixed_basis <order> <output header>
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <type_traits>
+
+#include <boost/math/constants/constants.hpp>
+
+#include "ZernikeBasis.hpp"
+
+int main(int argc, char ** argv)
+{
+    using std::cerr;
+    using std::endl;
+
+    if (argc != 3)
+    {
+        cerr << u8"Usage: " << argv[0] << u8" <order> <output header>" << endl;
+        return 1;
+    }
+
+    int order{ std::atoi(argv[1]) };
+
+    if (order <= 0)
+    {
+        cerr << u8"Order must be positive. Actual value is " << argv[1] << endl;
+        return 1;
+    }
+
+    using BasisT = ZernikeBasis<double>;
+
+    BasisT basis(order);
+
+    std::ofstream output(argv[2], std::ios_base::out | std::ios_base::trunc);
+
+    if (!output.is_open())
+    {
+        cerr << u8"Cannot open " << argv[2] << endl;
+        return 1;
+    }
+
+    // [0] real, [1] imaginary coefficients
+    const BasisT::Table * tables[2] = { &basis.GetRealTable(), &basis.GetImagTable() };
+
+    std::stringstream rows[2], terms[2];
+    int row_count{ 0 }, term_count[2]{ 0, 0 };
+
+    for (int t = 0; t < 2; ++t)
+    {
+        terms[t].precision(std::numeric_limits<double>::max_digits10);
+        rows[t] << 0;
+    }
+
+    for (int n = 0; n <= order; ++n)
+    {
+        for (int l = n % 2; l <= n; l += 2)
+        {
+            for (int m = 0; m <= l; ++m)
+            {
+                std::size_t row_index = basis.GetRowIndex(n, l / 2, m);
+
+                for (int t = 0; t < 2; ++t)
+                {
+                    for (std::uint64_t i = tables[t]->rowOffsets_[row_index]; i < tables[t]->rowOffsets_[row_index + 1]; ++i)
+                    {
+                        terms[t] << u8"            { " << tables[t]->columns_[i] << ", " << tables[t]->values_[i] << " },\n";
+                        term_count[t]++;
+                    }
+
+                    rows[t] << ", " << term_count[t];
+                }
+
+                row_count++;
+            }
+        }
+    }
+
+    output << u8"// Generated by generate_fixed_basis. Do not edit.\n"
+        << u8"#pragma once\n\n"
+        << u8"#include \"FixedZernikeMoments.hpp\"\n\n"
+        << u8"template<>\n"
+        << u8"struct FixedZernikeBasis<" << order << u8">\n"
+        << u8"{\n"
+        << u8"    static constexpr int order = " << order << u8";\n"
+        << u8"    static constexpr int rowCount = " << row_count << u8";\n"
+        << u8"    static constexpr int realTermCount = " << term_count[0] << u8";\n"
+        << u8"    static constexpr int imagTermCount = " << term_count[1] << u8";\n";
+
+    const char * names[2] = { u8"Real", u8"Imag" };
+    const char * counts[2] = { u8"realTermCount", u8"imagTermCount" };
+
+    for (int t = 0; t < 2; ++t)
+    {
+        output << u8"\n"
+            << u8"    static const int * " << names[t] << u8"RowOffsets()\n"
+            << u8"    {\n"
+            << u8"        static constexpr int rows[rowCount + 1] = { " << rows[t].str() << u8" };\n"
+            << u8"        return rows;\n"
+            << u8"    }\n\n"
+            << u8"    static const FixedZernikeTerm * " << names[t] << u8"Terms()\n"
+            << u8"    {\n";
+
+        // an empty constexpr array is ill-formed
+        if (term_count[t] == 0)
+        {
+            output << u8"        return nullptr;\n";
+        }
+        else
+        {
+            output << u8"        static constexpr FixedZernikeTerm terms[" << counts[t] << u8"] = {\n"
+                << terms[t].str()
+                << u8"        };\n"
+                << u8"        return terms;\n";
+        }
+
+        output << u8"    }\n";
+    }
+
+    output << u8"};\n";
+
+    if (!output.good())
+    {
+        cerr << u8"Unexpected IO error. Cannot write to " << argv[2] << endl;
+        return 1;
+    }
+
+    return 0;
+}